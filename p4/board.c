@@ -0,0 +1,232 @@
+/**
+   @file board.c
+   @author Selena Chen (schen53)
+
+   This component keeps a set of items in sorted order as they change, so the
+   contest can list problems and contestants in ranking order without sorting them
+   for every list command. It's an indexable skip list: every link records how many
+   items it skips over, so an item's position can be found, and a position can be
+   reached, in logarithmic time.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include "board.h"
+
+/** Most levels a node can have, enough for millions of items. */
+#define MAX_LEVEL 16
+
+/** Seed for picking node levels, so runs are repeatable. */
+#define LEVEL_SEED 2463534242u
+
+/** Link from a node to the next node on one level. */
+typedef struct NodeStruct Node;
+typedef struct {
+    /** Next node on this level, or NULL at the end. */
+    Node *next;
+
+    /** Number of positions between this node and the next one on this level. */
+    int width;
+} Link;
+
+/** Node of the skip list, holding one item. */
+struct NodeStruct {
+    /** Item stored in this node. */
+    void *item;
+
+    /** Links for each level this node is on, from the bottom up. */
+    Link link[];
+};
+
+/** Representation for a board. */
+struct BoardStruct {
+    /** Function ordering the items. */
+    int (*comp)( void const *, void const * );
+
+    /** Node before the first item, with a link on every level. */
+    Node *head;
+
+    /** Number of levels in use. */
+    int level;
+
+    /** Number of items on the board. */
+    int size;
+
+    /** State of the generator picking node levels. */
+    uint32_t seed;
+};
+
+/**
+   Allocates a node with the given number of levels.
+
+   @param item item for the node to hold.
+   @param level number of levels.
+   @return dynamically allocated node.
+ */
+static Node *makeNode( void *item, int level )
+{
+    Node *node = (Node *) malloc( sizeof( Node ) + level * sizeof( Link ) );
+    node->item = item;
+    return node;
+}
+
+/**
+   Picks the number of levels for a new node, each level having a quarter as many
+   nodes as the one below.
+
+   @param board board the node is for.
+   @return number of levels.
+ */
+static int pickLevel( Board *board )
+{
+    uint32_t x = board->seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    board->seed = x;
+    int level = 1;
+    while ( level < MAX_LEVEL && ( x & 3 ) == 0 ) {
+        level++;
+        x >>= 2;
+    }
+    return level;
+}
+
+/**
+   Finds, on each level, the last node whose item comes before the given one, and
+   its position.
+
+   @param board board to search.
+   @param item item to search for.
+   @param update array of board->level nodes to fill in.
+   @param pos array of board->level positions to fill in; the head is at 0.
+ */
+static void findBefore( Board *board, void const *item, Node **update, int *pos )
+{
+    Node *x = board->head;
+    int p = 0;
+    for ( int i = board->level - 1; i >= 0; i-- ) {
+        while ( x->link[ i ].next
+                && board->comp( x->link[ i ].next->item, item ) < 0 ) {
+            p += x->link[ i ].width;
+            x = x->link[ i ].next;
+        }
+        update[ i ] = x;
+        pos[ i ] = p;
+    }
+}
+
+Board *makeBoard( int (*comp)( void const *, void const * ) )
+{
+    Board *board = (Board *) malloc( sizeof( Board ) );
+    board->comp = comp;
+    board->head = makeNode( NULL, MAX_LEVEL );
+    board->level = 1;
+    board->size = 0;
+    board->seed = LEVEL_SEED;
+    board->head->link[ 0 ].next = NULL;
+    board->head->link[ 0 ].width = 1;
+    return board;
+}
+
+void freeBoard( Board *board )
+{
+    Node *node = board->head;
+    while ( node ) {
+        Node *next = node->link[ 0 ].next;
+        free( node );
+        node = next;
+    }
+    free( board );
+}
+
+int boardSize( Board *board )
+{
+    return board->size;
+}
+
+void boardInsert( Board *board, void *item )
+{
+    Node *update[ MAX_LEVEL ];
+    int pos[ MAX_LEVEL ];
+    findBefore( board, item, update, pos );
+
+    // A link past the last node counts the end as the position after the last item.
+    int level = pickLevel( board );
+    for ( ; board->level < level; board->level++ ) {
+        update[ board->level ] = board->head;
+        pos[ board->level ] = 0;
+        board->head->link[ board->level ].next = NULL;
+        board->head->link[ board->level ].width = board->size + 1;
+    }
+
+    Node *node = makeNode( item, level );
+    int p = pos[ 0 ] + 1;
+    for ( int i = 0; i < level; i++ ) {
+        Link *before = &update[ i ]->link[ i ];
+        node->link[ i ].next = before->next;
+        node->link[ i ].width = before->width - ( p - pos[ i ] ) + 1;
+        before->next = node;
+        before->width = p - pos[ i ];
+    }
+    for ( int i = level; i < board->level; i++ ) {
+        update[ i ]->link[ i ].width++;
+    }
+    board->size++;
+}
+
+void boardRemove( Board *board, void *item )
+{
+    Node *update[ MAX_LEVEL ];
+    int pos[ MAX_LEVEL ];
+    findBefore( board, item, update, pos );
+    Node *node = update[ 0 ]->link[ 0 ].next;
+    if ( !node || node->item != item ) {
+        return;
+    }
+
+    for ( int i = 0; i < board->level; i++ ) {
+        Link *before = &update[ i ]->link[ i ];
+        if ( before->next == node ) {
+            before->width += node->link[ i ].width - 1;
+            before->next = node->link[ i ].next;
+        } else {
+            before->width--;
+        }
+    }
+    free( node );
+    while ( board->level > 1 && !board->head->link[ board->level - 1 ].next ) {
+        board->level--;
+    }
+    board->size--;
+}
+
+int boardRank( Board *board, void const *item )
+{
+    Node *update[ MAX_LEVEL ];
+    int pos[ MAX_LEVEL ];
+    findBefore( board, item, update, pos );
+    Node *node = update[ 0 ]->link[ 0 ].next;
+    return node && node->item == item ? pos[ 0 ] : -1;
+}
+
+void walkBoard( Board *board, int start, int count, void (*visit)( void *, void * ),
+                void *data )
+{
+    if ( start < 0 || start >= board->size ) {
+        return;
+    }
+
+    // Find the node before the starting position, then follow the bottom level.
+    Node *x = board->head;
+    int p = 0;
+    for ( int i = board->level - 1; i >= 0; i-- ) {
+        while ( x->link[ i ].next && p + x->link[ i ].width <= start ) {
+            p += x->link[ i ].width;
+            x = x->link[ i ].next;
+        }
+    }
+    for ( x = x->link[ 0 ].next; x && count > 0; x = x->link[ 0 ].next, count-- ) {
+        visit( x->item, data );
+    }
+}
@@ -0,0 +1,81 @@
+/**
+   @file board.h
+   @author Selena Chen (schen53)
+
+   Contains function prototypes for board.c.
+ */
+
+#ifndef _BOARD_H_
+#define _BOARD_H_
+
+/** Short name for the board type. */
+typedef struct BoardStruct Board;
+
+/**
+   This dynamically allocates an empty board, which keeps items sorted by the given
+   comparison function. The function must order every pair of distinct items, so no
+   two items compare equal.
+
+   @param comp function returning a negative number if its first item comes before
+               its second, or a positive number if it comes after.
+   @return dynamically allocated board.
+ */
+Board *makeBoard( int (*comp)( void const *, void const * ) );
+
+/**
+   This frees the memory used for the given board, but not the items on it.
+
+   @param board board to be freed.
+ */
+void freeBoard( Board *board );
+
+/**
+   This returns the number of items on a board.
+
+   @param board board to check.
+   @return number of items on the board.
+ */
+int boardSize( Board *board );
+
+/**
+   This adds an item to a board, in logarithmic time on average.
+
+   @param board board to add the item to.
+   @param item item to add.
+ */
+void boardInsert( Board *board, void *item );
+
+/**
+   This removes an item from a board, in logarithmic time on average. The item must
+   still compare the way it did when it was inserted, so an item should be removed
+   before anything it's ordered by changes, and inserted again afterward.
+
+   @param board board to remove the item from.
+   @param item item to remove.
+ */
+void boardRemove( Board *board, void *item );
+
+/**
+   This returns the position of an item on a board, in logarithmic time on average.
+
+   @param board board to look on.
+   @param item item to look for.
+   @return zero-based position of the item, or -1 if it isn't on the board.
+ */
+int boardRank( Board *board, void const *item );
+
+/**
+   This calls a function for count items of the board in order, starting at the
+   given position. Finding the starting position takes logarithmic time on average,
+   and each item after that takes constant time.
+
+   @param board board to walk.
+   @param start zero-based position of the first item to visit.
+   @param count largest number of items to visit.
+   @param visit function to call with each item and the data pointer.
+   @param data extra information the visit function needs in order to do its job.
+ */
+void walkBoard( Board *board, int start, int count, void (*visit)( void *, void * ),
+                void *data );
+
+#endif
@@ -4,12 +4,38 @@
 
    This component is responsible for parsing and performing user commands. It uses
    the model component.
+
+   Standard input is read up to a large block at a time, and commands are parsed
+   straight out of the block by a few small scanning functions instead of a scanf
+   call per field. Each scanning function works just like the scanf conversion the
+   parser used to use, so commands are accepted or rejected as before. The one
+   exception is list contestants followed by a space and more text on the same
+   line, which is now read as top or page arguments; the old parser listed every
+   contestant and took the rest of the line as the next command.
+   Command names are recognized by switching on their length and then comparing the
+   few names of that length.
+
+   Output goes into a large buffer too, which is written out when it fills up,
+   before blocking to read more input, and at the end, so a prompt is always visible
+   by the time the program waits for the next command. List rows are formatted
+   straight into the buffer.
+
+   Every change a command makes to the contest is also passed to the snapshot
+   component, so it can be added to the event log of the last snapshot saved or
+   loaded.
  */
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
 #include <string.h>
+#include <ctype.h>
+#include <limits.h>
+#include <errno.h>
+#include <unistd.h>
 #include "model.h"
+#include "command.h"
+#include "snapshot.h"
 
 /** Max character length of an id. */
 #define MAX_ID_LENGTH 16
@@ -17,64 +43,387 @@
 /** Max character length of a name. */
 #define MAX_NAME_LENGTH 40
 
+/** Max character length of a snapshot file name. */
+#define MAX_FILE_LENGTH 255
+
 /** Max character length of a command. */
 #define MAX_CMD_LENGTH 11
 
-/** Value of a penalty for an attempt. */
-#define PENALTY_AMT 20
+/** Max character length of the first word of a command. */
+#define MAX_FIRST_LENGTH 10
+
+/** Number of bytes of standard input read at a time. */
+#define INPUT_BLOCK ( 1 << 20 )
+
+/** Size of the output buffer. */
+#define OUTPUT_BLOCK ( 1 << 20 )
+
+/** Longest row of a list, with room to spare: an id, a name, two counts and a rank,
+    with the spaces between them. */
+#define MAX_ROW 128
+
+/** Width of a count column in a list. */
+#define COUNT_WIDTH 9
+
+/** Names of the commands and list types. */
+typedef enum {
+    UNKNOWN, PROBLEM, CONTESTANT, ATTEMPT, SOLVED, LIST, RANK, QUIT, SAVE, LOAD,
+    PROBLEMS, CONTESTANTS, UNSOLVED
+} Command;
+
+/** Text the commands are parsed from. */
+static struct {
+    /** Characters available to parse, and how many there are. */
+    char const *data;
+    size_t len;
+
+    /** Position of the next character to parse. */
+    size_t pos;
+
+    /** True if more characters can be read from standard input when these run
+        out. */
+    bool refill;
+
+    /** True once parsing has run into the end of the input. */
+    bool ended;
+} input = { NULL, 0, 0, true, false };
+
+/** Block of standard input, with room to keep the last character of the previous
+    block in front of it. */
+static char block[ INPUT_BLOCK + 1 ];
+
+/** Output waiting to be written, and how much of the buffer it fills. */
+static char outBuf[ OUTPUT_BLOCK ];
+static size_t outLen = 0;
+
+/** True if a prompt is printed before each command. */
+static bool prompts = true;
+
+void flushOutput( void )
+{
+    fwrite( outBuf, 1, outLen, stdout );
+    fflush( stdout );
+    outLen = 0;
+}
+
+void output( char const *format, ... )
+{
+    va_list args, again;
+    va_start( args, format );
+    va_copy( again, args );
+    size_t room = OUTPUT_BLOCK - outLen;
+    int n = vsnprintf( outBuf + outLen, room, format, args );
+    if ( n >= 0 && (size_t) n >= room ) {
+        // It didn't fit, so make room and format it again.
+        flushOutput();
+        n = vsnprintf( outBuf, OUTPUT_BLOCK, format, again );
+        n = n < OUTPUT_BLOCK ? n : OUTPUT_BLOCK - 1;
+    }
+    outLen += n > 0 ? n : 0;
+    va_end( again );
+    va_end( args );
+}
 
 /**
-   Orders problems by their difficulty rating.
+   Adds a string to the output, padded with spaces on the right to the given width,
+   like %-16s.
 
-   @param problem1 first problem to be ordered.
-   @param problem2 second problem to be ordered.
-   @return -1 if problem1 comes before problem2, 1 if problem1 comes after problem2,
-            or 0 if problem1 is equal to problem2.
+   @param text string to add.
+   @param width smallest number of characters to add.
  */
-static int pComp( const void *problem1, const void *problem2 )
+static void putPadded( char const *text, int width )
 {
-    Problem const *p1 = *( (Problem **) problem1 );
-    Problem const *p2 = *( (Problem **) problem2 );
-    if ( p1->sCount > p2->sCount ) {
-        return -1;
-    } else if ( p1->sCount < p2->sCount ) {
-        return 1;
-    } else {
-        if ( p1->aCount < p2->aCount ) {
-            return -1;
-        } else if ( p1->aCount > p2->aCount ) {
-            return 1;
-        } else {
-            return strcmp( p1->id, p2->id );
+    size_t len = strlen( text );
+    memcpy( outBuf + outLen, text, len );
+    outLen += len;
+    for ( ; (int) len < width; len++ ) {
+        outBuf[ outLen++ ] = ' ';
+    }
+}
+
+/**
+   Adds a space and a number to the output, right-justified in a count column, like
+   " %9d".
+
+   @param value number to add.
+ */
+static void putCount( int value )
+{
+    char digits[ COUNT_WIDTH + 3 ];
+    int n = 0;
+    long long v = value < 0 ? -(long long) value : value;
+    do {
+        digits[ n++ ] = '0' + v % 10;
+        v /= 10;
+    } while ( v );
+    if ( value < 0 ) {
+        digits[ n++ ] = '-';
+    }
+    outBuf[ outLen++ ] = ' ';
+    for ( int i = n; i < COUNT_WIDTH; i++ ) {
+        outBuf[ outLen++ ] = ' ';
+    }
+    while ( n > 0 ) {
+        outBuf[ outLen++ ] = digits[ --n ];
+    }
+}
+
+/**
+   Adds one row of a list to the output, formatted like "\n%-16s %-40s %9d %9d".
+
+   @param id id of the problem or contestant.
+   @param name its name.
+   @param first number for the first count column.
+   @param second number for the second count column.
+ */
+static void putRow( char const *id, char const *name, int first, int second )
+{
+    if ( outLen + MAX_ROW > OUTPUT_BLOCK ) {
+        flushOutput();
+    }
+    outBuf[ outLen++ ] = '\n';
+    putPadded( id, MAX_ID_LENGTH );
+    outBuf[ outLen++ ] = ' ';
+    putPadded( name, MAX_NAME_LENGTH );
+    putCount( first );
+    putCount( second );
+}
+
+void setCommandText( char const *text, size_t len )
+{
+    input.data = text;
+    input.len = len;
+    input.pos = 0;
+    input.refill = false;
+}
+
+void setPrompts( bool show )
+{
+    prompts = show;
+}
+
+/**
+   Reads the next block of standard input. The last character of the previous block
+   is kept at the front, so it can still be put back after it's been read.
+
+   @return true if any more characters were read.
+ */
+static bool fillInput( void )
+{
+    if ( !input.refill ) {
+        return false;
+    }
+
+    // Reading may block, so let the user see everything up to the prompt first.
+    flushOutput();
+    if ( input.len > 0 ) {
+        block[ 0 ] = block[ input.len - 1 ];
+        input.len = input.pos = 1;
+    }
+    input.data = block;
+
+    // A single read returns whatever is available, so a user typing commands
+    // doesn't have to fill a whole block before the first one is processed.
+    ssize_t n;
+    do {
+        n = read( STDIN_FILENO, block + input.len, INPUT_BLOCK );
+    } while ( n < 0 && errno == EINTR );
+    n = n > 0 ? n : 0;
+    input.len += n;
+    input.refill = n > 0;
+    return n > 0;
+}
+
+/**
+   Returns the next character of the input without consuming it, like getchar()
+   followed by ungetc().
+
+   @return next character, or EOF at the end of the input.
+ */
+static int peekChar( void )
+{
+    if ( input.pos == input.len && !fillInput() ) {
+        input.ended = true;
+        return EOF;
+    }
+    return (unsigned char) input.data[ input.pos ];
+}
+
+/**
+   Consumes the next character of the input, like getchar().
+
+   @return the character, or EOF at the end of the input.
+ */
+static int getChar( void )
+{
+    int ch = peekChar();
+    if ( ch != EOF ) {
+        input.pos++;
+    }
+    return ch;
+}
+
+/**
+   Puts back the character just returned by getChar(), like ungetc().
+
+   @param ch character to put back.
+ */
+static void ungetChar( int ch )
+{
+    if ( ch != EOF ) {
+        input.pos--;
+    }
+}
+
+/**
+   Skips any whitespace, including newlines, like a space in a scanf format.
+ */
+static void skipSpace( void )
+{
+    int ch;
+    while ( ( ch = peekChar() ) != EOF && isspace( ch ) ) {
+        input.pos++;
+    }
+}
+
+/**
+   Skips to the end of the current line, leaving the newline, like %*[^\n].
+ */
+static void skipLine( void )
+{
+    while ( peekChar() != EOF ) {
+        char const *end = memchr( input.data + input.pos, '\n',
+                                  input.len - input.pos );
+        if ( end ) {
+            input.pos = end - input.data;
+            return;
         }
+        input.pos = input.len;
     }
 }
 
 /**
-   Orders contestants by their difficulty rating.
+   Reads a field of at most width characters, ending before a newline, and before a
+   space if spaceEnds is true, like %16[^ \n] or %40[^\n].
 
-   @param contestant1 first contestant to be ordered.
-   @param contestant2 second contestant to be ordered.
-   @return -1 if contestant1 comes before contestant2, 1 if contestant1 comes after.
-            contestant2, or 0 if contestant1 is equal to contestant2.
+   @param field array of at least width + 1 characters to store the field in.
+   @param width largest number of characters to read.
+   @param spaceEnds true if a space ends the field.
+   @return number of characters read; zero means the conversion failed.
  */
-static int cComp( const void *contestant1, const void *contestant2 )
+static int readField( char *field, int width, bool spaceEnds )
 {
-    Contestant const *c1 = *( (Contestant **) contestant1 );
-    Contestant const *c2 = *( (Contestant **) contestant2 );
-    if ( c1->sCount > c2->sCount ) {
-        return -1;
-    } else if ( c1->sCount < c2->sCount ) {
-        return 1;
-    } else {
-        if ( c1->penalty < c2->penalty ) {
-            return -1;
-        } else if ( c1->penalty > c2->penalty ) {
-            return 1;
-        } else {
-            return strcmp( c1->id, c2->id );
+    int n = 0;
+    while ( n < width && peekChar() != EOF ) {
+        // Copy straight out of the block until it runs out or the field ends.
+        char const *p = input.data + input.pos;
+        char const *end = input.data + input.len;
+        while ( n < width && p < end && *p != '\n' && !( spaceEnds && *p == ' ' ) ) {
+            field[ n++ ] = *p++;
+        }
+        input.pos = p - input.data;
+        if ( p < end ) {
+            break;
         }
     }
+    field[ n ] = '\0';
+    return n;
+}
+
+/**
+   Skips any spaces and tabs, without going on to the next line.
+ */
+static void skipBlanks( void )
+{
+    int ch;
+    while ( ( ch = peekChar() ) == ' ' || ch == '\t' ) {
+        input.pos++;
+    }
+}
+
+/**
+   Reads a decimal integer after any spaces and tabs, like %d, except that the
+   integer has to be on the same line.
+
+   @param value pointer to where the integer should be stored.
+   @return true if an integer was read.
+ */
+static bool readInt( int *value )
+{
+    skipBlanks();
+    int ch = peekChar();
+    bool negative = ch == '-';
+    if ( ch == '-' || ch == '+' ) {
+        input.pos++;
+    }
+    if ( !isdigit( peekChar() ) ) {
+        return false;
+    }
+    long long v = 0;
+    while ( isdigit( ch = peekChar() ) ) {
+        v = v * 10 + ( ch - '0' );
+        v = v > INT_MAX ? (long long) INT_MAX + 1 : v;
+        input.pos++;
+    }
+    v = negative ? -v : v;
+    *value = v > INT_MAX ? INT_MAX : v < INT_MIN ? INT_MIN : v;
+    return true;
+}
+
+/**
+   Returns the command or list type named by a word.
+
+   @param word word to look up.
+   @param len number of characters in the word.
+   @return the command, or UNKNOWN.
+ */
+static Command lookupCommand( char const *word, int len )
+{
+    switch ( len ) {
+        case 4:
+            if ( memcmp( word, "list", 4 ) == 0 ) {
+                return LIST;
+            } else if ( memcmp( word, "rank", 4 ) == 0 ) {
+                return RANK;
+            } else if ( memcmp( word, "quit", 4 ) == 0 ) {
+                return QUIT;
+            } else if ( memcmp( word, "save", 4 ) == 0 ) {
+                return SAVE;
+            } else if ( memcmp( word, "load", 4 ) == 0 ) {
+                return LOAD;
+            }
+            break;
+        case 6:
+            if ( memcmp( word, "solved", 6 ) == 0 ) {
+                return SOLVED;
+            }
+            break;
+        case 7:
+            if ( memcmp( word, "problem", 7 ) == 0 ) {
+                return PROBLEM;
+            } else if ( memcmp( word, "attempt", 7 ) == 0 ) {
+                return ATTEMPT;
+            }
+            break;
+        case 8:
+            if ( memcmp( word, "problems", 8 ) == 0 ) {
+                return PROBLEMS;
+            } else if ( memcmp( word, "unsolved", 8 ) == 0 ) {
+                return UNSOLVED;
+            }
+            break;
+        case 10:
+            if ( memcmp( word, "contestant", 10 ) == 0 ) {
+                return CONTESTANT;
+            }
+            break;
+        case 11:
+            if ( memcmp( word, "contestants", 11 ) == 0 ) {
+                return CONTESTANTS;
+            }
+            break;
+    }
+    return UNKNOWN;
 }
 
 /**
@@ -96,14 +445,7 @@ static bool problemsTest( Problem *problem, void *data ) {
    @return true if the problem is solved, false otherwise.
  */
 static bool solvedTest( Problem *problem, void *data ) {
-    Contestant *contestant = (Contestant *) data;
-    for ( int i = 0; i < contestant->aCount; i++ ) {
-        if ( strcmp( problem->id, contestant->aList[ i ].problem->id ) == 0
-            && contestant->aList[ i ].solved ) {
-            return true;
-        }
-    }
-    return false;
+    return hasSolved( (Contestant *) data, problem );
 }
 
 /**
@@ -114,14 +456,44 @@ static bool solvedTest( Problem *problem, void *data ) {
    @return false if the problem is solved, true otherwise
  */
 static bool unsolvedTest( Problem *problem, void *data ) {
-    Contestant *contestant = (Contestant *) data;
-    for ( int i = 0; i < contestant->aCount; i++ ) {
-        if ( strcmp( problem->id, contestant->aList[ i ].problem->id ) == 0
-            && contestant->aList[ i ].solved ) {
-            return false;
-        }
+    return !hasSolved( (Contestant *) data, problem );
+}
+
+/** Test function and data for choosing which problems to list. */
+typedef struct {
+    /** Function that decides which problems to report. */
+    bool (*test)( Problem *, void * );
+
+    /** Additional data the test function might need to do its job. */
+    void *data;
+} Filter;
+
+/**
+   Prints a problem's row of a problem list, if the filter chooses it.
+
+   @param item problem to print.
+   @param data the Filter.
+ */
+static void printProblem( void *item, void *data )
+{
+    Problem *problem = (Problem *) item;
+    Filter *filter = (Filter *) data;
+    if ( filter->test( problem, filter->data ) ) {
+        putRow( problem->id, problem->name, problem->sCount, problem->aCount );
     }
-    return true;
+}
+
+/**
+   Prints a contestant's row of the contestant list.
+
+   @param item contestant to print.
+   @param data unused.
+ */
+static void printContestant( void *item, void *data )
+{
+    Contestant *contestant = (Contestant *) item;
+    putRow( contestant->id, contestant->name, contestant->sCount,
+            contestant->penalty );
 }
 
 /**
@@ -135,200 +507,279 @@ static bool unsolvedTest( Problem *problem, void *data ) {
    @param test function that decides which problems to report.
    @param data additional data the test function might need to do its job.
  */
-static void listProblems( Contest *contest, bool (*test)( Problem *, void * ), void *data )
+static void listProblems( Contest *contest, bool (*test)( Problem *, void * ),
+                          void *data )
+{
+    Filter filter = { test, data };
+    walkBoard( contest->pBoard, 0, boardSize( contest->pBoard ), printProblem,
+               &filter );
+}
+
+/**
+   Reads the rest of a list contestants command and prints the list. The command can
+   end with top K, to list just the first K contestants, or with page P SIZE, to
+   list the Pth group of SIZE contestants, counting from 1. Either way, the
+   contestants before the ones listed are skipped without being visited.
+
+   The old parser didn't read anything after the word contestants, so the arguments
+   have to be separated from it by a space, and anything else is left for the next
+   command. Reaching the end of the input here doesn't end the commands yet either,
+   so the last prompt is still printed, as it used to be.
+
+   @param contest contest whose contestants are listed.
+   @return true if the rest of the command is valid.
+ */
+static bool listContestants( Contest *contest )
+{
+    int start = 0;
+    int count = contest->cCount;
+    if ( peekChar() == ' ' ) {
+        skipBlanks();
+        int ch = peekChar();
+        if ( ch != '\n' && ch != EOF ) {
+            char word[ MAX_CMD_LENGTH + 1 ];
+            int page, size;
+            readField( word, MAX_CMD_LENGTH, true );
+            if ( strcmp( "top", word ) == 0 && readInt( &count ) && count >= 0 ) {
+                // Just the first count contestants.
+            } else if ( strcmp( "page", word ) == 0 && readInt( &page )
+                        && readInt( &size ) && page >= 1 && size >= 1 ) {
+                long long first = (long long) ( page - 1 ) * size;
+                start = first < contest->cCount ? first : contest->cCount;
+                count = size;
+            } else {
+                skipLine();
+                return false;
+            }
+        }
+    }
+    output( "\n%-16s %-40s %9s %9s", "ID", "Name", "Solved", "Penalty" );
+    walkBoard( contest->cBoard, start, count, printContestant, NULL );
+
+    // The next command will find the end of the input again.
+    input.ended = false;
+    return true;
+}
+
+/**
+   Reads the id and name for a problem or contestant command. The id must be
+   followed by a single space, and the name must be followed by the end of the line.
+
+   @param id array to store the id in.
+   @param name array to store the name in.
+   @return true if they were read successfully.
+ */
+static bool readIdAndName( char *id, char *name )
+{
+    int ch;
+    skipSpace();
+    if ( !readField( id, MAX_ID_LENGTH, true ) || ( ch = getChar() ) != ' ' ) {
+        skipLine();
+        return false;
+    }
+    ungetChar( ch );
+    skipSpace();
+    if ( !readField( name, MAX_NAME_LENGTH, false ) || ( ch = getChar() ) != '\n' ) {
+        skipLine();
+        return false;
+    }
+    ungetChar( ch );
+    return true;
+}
+
+/**
+   Reads the contestant and problem for an attempt or solved command, and looks them
+   up.
+
+   @param contest contest to look them up in.
+   @param contestant pointer to where the contestant should be stored.
+   @param problem pointer to where the problem should be stored.
+   @return true if they were read successfully and both exist.
+ */
+static bool readAttempt( Contest *contest, Contestant **contestant,
+                         Problem **problem )
+{
+    char contestantID[ MAX_NAME_LENGTH + 1 ];
+    char problemID[ MAX_NAME_LENGTH + 1 ];
+    int ch;
+    skipSpace();
+    if ( !readField( contestantID, MAX_ID_LENGTH, true )
+         || ( ch = getChar() ) != ' ' ) {
+        skipLine();
+        return false;
+    }
+    ungetChar( ch );
+    skipSpace();
+    if ( !readField( problemID, MAX_NAME_LENGTH, false ) ) {
+        skipLine();
+        return false;
+    }
+    *contestant = findContestant( contest, contestantID );
+    *problem = findProblem( contest, problemID );
+    return *contestant && *problem;
+}
+
+/**
+   Performs a list command.
+
+   @param contest contest whose problems or contestants are listed.
+   @return true if the command is valid.
+ */
+static bool listCommand( Contest *contest )
 {
-    for ( int i = 0; i < contest->pCount; i++ ) {
-        Problem *problem = contest->pList[ i ];
-        if ( test( problem, data ) ) {
-            printf( "\n%-16s %-40s %9d %9d", problem->id, problem->name, problem->sCount,
-                    problem->aCount );
+    char type[ MAX_CMD_LENGTH + 1 ];
+    char id[ MAX_ID_LENGTH + 1 ];
+    skipSpace();
+    int len = readField( type, MAX_CMD_LENGTH, true );
+    Command list = lookupCommand( type, len );
+    if ( list == PROBLEMS ) {
+        output( "\n%-16s %-40s %9s %9s", "ID", "Name", "Solutions", "Attempts" );
+        listProblems( contest, problemsTest, NULL );
+    } else if ( list == CONTESTANTS ) {
+        return listContestants( contest );
+    } else if ( list == SOLVED || list == UNSOLVED ) {
+        output( "\n%-16s %-40s %9s %9s", "ID", "Name", "Solutions", "Attempts" );
+        skipSpace();
+        if ( !readField( id, MAX_ID_LENGTH, true ) ) {
+            // A missing id ends an unsolved list quietly.
+            skipLine();
+            return list == UNSOLVED;
         }
+        // The old parser listed no problems for an unknown contestant when there
+        // weren't any, and crashed testing them otherwise.
+        Contestant *contestant = findContestant( contest, id );
+        if ( !contestant && boardSize( contest->pBoard ) > 0 ) {
+            return false;
+        }
+        listProblems( contest, list == SOLVED ? solvedTest : unsolvedTest,
+                      contestant );
+    } else {
+        skipLine();
+        return false;
+    }
+    return true;
+}
+
+/**
+   Performs a rank command, printing a contestant's row and place.
+
+   @param contest contest the contestant is in.
+   @return true if the command is valid.
+ */
+static bool rankCommand( Contest *contest )
+{
+    char id[ MAX_ID_LENGTH + 1 ];
+    Contestant *contestant = NULL;
+    skipSpace();
+    if ( !readField( id, MAX_ID_LENGTH, true )
+         || !( contestant = findContestant( contest, id ) ) ) {
+        skipLine();
+        return false;
+    }
+    output( "\n%-16s %-40s %9s %9s %9s", "ID", "Name", "Solved", "Penalty", "Rank" );
+    printContestant( contestant, NULL );
+    putCount( boardRank( contest->cBoard, contestant ) + 1 );
+    return true;
+}
+
+/**
+   Performs a save or load command. The file name must be followed by the end of the
+   line.
+
+   @param contest contest to save, or to replace with the loaded one.
+   @param save true to save the contest, false to load it.
+   @return true if the command is valid and the snapshot was saved or loaded.
+ */
+static bool snapshotCommand( Contest *contest, bool save )
+{
+    char filename[ MAX_FILE_LENGTH + 1 ];
+    skipSpace();
+    if ( !readField( filename, MAX_FILE_LENGTH, true ) ) {
+        skipLine();
+        return false;
     }
+    while ( peekChar() == ' ' ) {
+        getChar();
+    }
+    if ( peekChar() != '\n' && peekChar() != EOF ) {
+        skipLine();
+        return false;
+    }
+    if ( save ) {
+        return saveSnapshot( contest, filename );
+    }
+    return loadSnapshot( contest, filename );
+}
+
+bool commandsEnded( void )
+{
+    return input.ended;
 }
 
 bool processCommand( Contest *contest )
 {
     static int cmdNum = 1;
-    char cmd[ MAX_CMD_LENGTH + 1 ];
-    printf( "%d> ", cmdNum );
+    if ( prompts ) {
+        output( "%d> ", cmdNum );
+    }
     cmdNum++;
-    if ( scanf( " %10[^ \n]", cmd ) == 1 ) {
-        if ( strcmp( "problem", cmd ) == 0 ) {
-            char id[ MAX_ID_LENGTH + 1 ];
-            char name[ MAX_NAME_LENGTH + 1 ];
-            int ch;
-            if ( scanf( " %16[^ \n]", id ) != 1 || ( ch = getchar() ) != ' ' ) {
-                scanf( "%*[^\n]" );
-                return false;
-            }
-            ungetc( ch, stdin );
-            if ( scanf( " %40[^\n]", name ) != 1 || ( ch = getchar() ) != '\n' ) {
-                scanf( "%*[^\n]" );
-                return false;
-            }
-            ungetc( ch, stdin );
-            if ( findProblem( contest, id ) ) {
-                scanf( "%*[^\n]" );
-                return false;
-            }
-            if ( contest->pCount + 1 >= contest->pCap ) {
-                contest->pCap *= 2;
-                contest->pList = (Problem **) realloc( contest->pList,
-                                    contest->pCap * sizeof( Problem * ) );
-            }
-            contest->pList[ contest->pCount ] = makeProblem( id, name );
-            contest->pCount++;
-        } else if ( strcmp( "contestant", cmd ) == 0 ) {
-            char id[ MAX_ID_LENGTH + 1 ];
-            char name[ MAX_NAME_LENGTH + 1 ];
-            int ch;
-            if ( scanf( " %16[^ \n]", id ) != 1 || ( ch = getchar() ) != ' ' ) {
-                scanf( "%*[^\n]" );
-                return false;
-            }
-            ungetc( ch, stdin );
-            if ( scanf( " %40[^\n]", name ) != 1 || ( ch = getchar() ) != '\n' ) {
-                scanf( "%*[^\n]" );
-                return false;
-            }
-            ungetc( ch, stdin );
-            if ( findContestant( contest, id ) ) {
-                scanf( "%*[^\n]" );
-                return false;
-            }
-            if ( contest->cCount + 1 >= contest->cCap ) {
-                contest->cCap *= 2;
-                contest->cList = (Contestant **) realloc( contest->cList,
-                                    contest->cCap * sizeof( Contestant * ) );
-            }
-            contest->cList[ contest->cCount ] = makeContestant( id, name );
-            contest->cCount++;
-        } else if ( strcmp( "attempt", cmd ) == 0 ) {
-            char contestantID[ MAX_NAME_LENGTH + 1 ];
-            char problemID[ MAX_NAME_LENGTH + 1 ];
-            int ch;
-            if ( scanf( " %16[^ \n]", contestantID ) != 1 || ( ch = getchar() ) != ' ' ) {
-                scanf( "%*[^\n]" );
-                return false;
-            }
-            ungetc( ch, stdin );
-            if ( scanf( " %40[^\n]", problemID ) != 1 ) {
-                scanf( "%*[^\n]" );
-                return false;
-            }
-            Contestant *contestant = findContestant( contest, contestantID );
-            Problem *problem = findProblem( contest, problemID );
-            if ( contestant->aCount + 1 >= contestant->aCap ) {
-                contestant->aCap *= 2;
-                contestant->aList = (Attempt *) realloc( contestant->aList,
-                                        contestant->aCap * sizeof( Attempt ) );
-            }
-            int count = contestant->aCount;
-            for ( int i = 0; i < count; i++ ) {
-                if ( strcmp( problem->id, contestant->aList[ i ].problem->id ) == 0
-                    && contestant->aList[ i ].solved ) {
-                    return true;
-                }
-            }
-            contestant->aList[ contestant->aCount ].problem = problem;
-            contestant->aList[ contestant->aCount ].solved = false;
-            contestant->aCount++;
-            problem->aCount++;
-        } else if ( strcmp( "solved", cmd ) == 0 ) {
-            char contestantID[ MAX_NAME_LENGTH + 1 ];
-            char problemID[ MAX_NAME_LENGTH + 1 ];
-            int ch;
-            if ( ( scanf( " %16[^ \n]", contestantID ) != 1 ) || ( ( ch = getchar() ) != ' ' ) ) {
-                scanf( "%*[^\n]" );
+    skipSpace();
+    if ( peekChar() == EOF ) {
+        return true;
+    }
+
+    char cmd[ MAX_FIRST_LENGTH + 1 ];
+    char id[ MAX_ID_LENGTH + 1 ];
+    char name[ MAX_NAME_LENGTH + 1 ];
+    Contestant *contestant;
+    Problem *problem;
+    int len = readField( cmd, MAX_FIRST_LENGTH, true );
+    switch ( lookupCommand( cmd, len ) ) {
+        case PROBLEM:
+            if ( !readIdAndName( id, name ) || findProblem( contest, id ) ) {
                 return false;
             }
-            ungetc( ch, stdin );
-            if ( scanf( " %40[^\n]", problemID ) != 1 ) {
-                scanf( "%*[^\n]" );
+            problem = makeProblem( id, name );
+            addProblem( contest, problem );
+            logProblem( problem );
+            return true;
+        case CONTESTANT:
+            if ( !readIdAndName( id, name ) || findContestant( contest, id ) ) {
                 return false;
             }
-            Contestant *contestant = findContestant( contest, contestantID );
-            Problem *problem = findProblem( contest, problemID );
-            if ( contestant->aCount + 1 >= contestant->aCap ) {
-                contestant->aCap *= 2;
-                contestant->aList = (Attempt *) realloc( contestant->aList,
-                                        contestant->aCap * sizeof( Attempt ) );
-            }
-            int penaltyCount = 0;
-            for ( int i = 0; i < contestant->aCount; i++ ) {
-                if ( strcmp( problem->id, contestant->aList[ i ].problem->id ) == 0
-                    && !contestant->aList[ i ].solved ) {
-                    penaltyCount++;
-                }
-            }
-            for ( int i = 0; i < penaltyCount; i++ ) {
-                contestant->penalty += PENALTY_AMT;
-            }
-            int count = contestant->aCount;
-            for ( int i = 0; i < count; i++ ) {
-                if ( strcmp( problem->id, contestant->aList[ i ].problem->id ) == 0
-                    && contestant->aList[ i ].solved ) {
-                    return true;
-                }
-            }
-            contestant->aList[ contestant->aCount ].problem = problem;
-            contestant->aList[ contestant->aCount ].solved = true;
-            contestant->aCount++;
-            contestant->sCount++;
-            problem->aCount++;
-            problem->sCount++;
-        } else if ( strcmp( "list", cmd ) == 0 ) {
-            if ( scanf( " %11[^ \n]", cmd ) != 1 ) {
-                scanf( "%*[^\n]" );
+            contestant = makeContestant( id, name );
+            addContestant( contest, contestant );
+            logContestant( contestant );
+            return true;
+        case ATTEMPT:
+            if ( !readAttempt( contest, &contestant, &problem ) ) {
                 return false;
             }
-            if ( strcmp( "problems", cmd ) == 0 ) {
-                printf( "\n%-16s %-40s %9s %9s", "ID", "Name", "Solutions", "Attempts" );
-                if ( contest->pCount > 0 ) {
-                    qsort( contest->pList, contest->pCount, sizeof( Problem * ), pComp );
-                    listProblems( contest, problemsTest, NULL );
-                }
-            } else if ( strcmp( "contestants", cmd ) == 0 ) {
-                printf( "\n%-16s %-40s %9s %9s", "ID", "Name", "Solved", "Penalty" );
-                if ( contest->cCount > 0 ) {
-                    qsort( contest->cList, contest->cCount, sizeof( Contestant * ), cComp );
-                    for ( int i = 0; i < contest->cCount; i++ ) {
-                        Contestant *contestant = contest->cList[ i ];
-                        printf( "\n%-16s %-40s %9d %9d", contestant->id, contestant->name,
-                                contestant->sCount, contestant->penalty );
-                    }
-                }
-            } else if ( strcmp( "solved", cmd ) == 0 ) {
-                printf( "\n%-16s %-40s %9s %9s", "ID", "Name", "Solutions", "Attempts" );
-                char id[ MAX_ID_LENGTH + 1 ];
-                if ( scanf( " %16[^ \n]", id ) != 1 ) {
-                    scanf( "%*[^\n]" );
-                    return false;
-                }
-                Contestant *contestant = findContestant( contest, id );
-                qsort( contest->pList, contest->pCount, sizeof( contest->pList[ 0 ] ), pComp );
-                listProblems( contest, solvedTest, contestant );
-            } else if ( strcmp( "unsolved", cmd ) == 0 ) {
-                printf( "\n%-16s %-40s %9s %9s", "ID", "Name", "Solutions", "Attempts" );
-                char id[ MAX_ID_LENGTH + 1 ];
-                if ( scanf( " %16[^ \n]", id ) != 1 ) {
-                    return true;
-                }
-                Contestant *contestant = findContestant( contest, id );
-                qsort( contest->pList, contest->pCount, sizeof( contest->pList[ 0 ] ), pComp );
-                listProblems( contest, unsolvedTest, contestant );
-            } else {
-                scanf( "%*[^\n]" );
+            recordAttempt( contest, contestant, problem );
+            logAttempt( contestant, problem, false );
+            return true;
+        case SOLVED:
+            if ( !readAttempt( contest, &contestant, &problem ) ) {
                 return false;
             }
-        } else if ( strcmp( "quit", cmd ) == 0 ) {
-            printf( "\n" );
+            recordSolved( contest, contestant, problem );
+            logAttempt( contestant, problem, true );
+            return true;
+        case LIST:
+            return listCommand( contest );
+        case RANK:
+            return rankCommand( contest );
+        case SAVE:
+        case LOAD:
+            return snapshotCommand( contest, lookupCommand( cmd, len ) == SAVE );
+        case QUIT:
+            output( "\n" );
+            flushOutput();
+            closeLog();
             freeContest( contest );
             exit( EXIT_SUCCESS );
-        } else {
-            scanf( "%*[^\n]" );
+        default:
+            skipLine();
             return false;
-        }
     }
-    return true;
 }
@@ -5,6 +5,8 @@
    Contains function prototypes for command.c.
  */
 
+#include <stddef.h>
+
 /**
    This function reads a user command from standard input and performs that
    command, updating or using the given contest instance as necessary. If the user
@@ -14,3 +16,43 @@
    @return true if the command is processed successfully, false otherwise.
  */
 bool processCommand( Contest *contest );
+
+/**
+   This function reports whether parsing commands has reached the end of the input.
+   Input is read ahead in large blocks, so this is what tells when the commands have
+   run out, rather than feof( stdin ).
+
+   @return true if there are no more commands to process.
+ */
+bool commandsEnded( void );
+
+/**
+   This function makes processCommand() parse commands from the given text instead
+   of standard input. The text isn't copied, so it has to stay in place until the
+   commands have all been processed.
+
+   @param text text of the commands.
+   @param len number of characters in the text.
+ */
+void setCommandText( char const *text, size_t len );
+
+/**
+   This function turns the prompt printed before each command on or off.
+
+   @param show true if prompts should be printed.
+ */
+void setPrompts( bool show );
+
+/**
+   This function adds formatted text to the output buffer, like printf(). The buffer
+   is written to standard output when it fills up, before the program waits for more
+   input, and when flushOutput() is called.
+
+   @param format printf-style format string.
+ */
+void output( char const *format, ... );
+
+/**
+   This function writes everything in the output buffer to standard output.
+ */
+void flushOutput( void );
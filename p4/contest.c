@@ -3,28 +3,90 @@
    @author Selena Chen (schen53)
    This is the top-level main component. It uses the other two components to
    represent the contest and respond to user commands.
+
+   With the --replay option, commands are read from the named event log instead of
+   standard input, and no prompts are printed, so a whole contest can be replayed
+   for auditing. The log is mapped into memory and parsed in place.
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "model.h"
 #include "command.h"
+#include "snapshot.h"
+
+#define REPLAY_OPT "--replay"
+
+/**
+   Maps an event log into memory and makes it the source of the commands. If the
+   log can't be mapped, this prints an error message and terminates the program.
+
+   @param filename name of the event log.
+   @param len pointer to where the length of the mapping should be stored.
+   @return start of the mapping, or NULL for an empty log.
+ */
+static void *mapLog( char const *filename, size_t *len )
+{
+    int fd = open( filename, O_RDONLY );
+    struct stat st;
+    if ( fd < 0 || fstat( fd, &st ) != 0 ) {
+        perror( filename );
+        exit( EXIT_FAILURE );
+    }
+    *len = st.st_size;
+    void *text = NULL;
+    if ( *len > 0 ) {
+        text = mmap( NULL, *len, PROT_READ, MAP_PRIVATE, fd, 0 );
+        if ( text == MAP_FAILED ) {
+            perror( filename );
+            exit( EXIT_FAILURE );
+        }
+        posix_madvise( text, *len, POSIX_MADV_SEQUENTIAL );
+    }
+    close( fd );
+    setCommandText( text, *len );
+    return text;
+}
 
 /**
    Program starting point.
+   @param argc number of command line arguments.
+   @param argv command line arguments.
    @return program exit status.
  */
-int main()
+int main( int argc, char *argv[] )
 {
+    void *log = NULL;
+    size_t logLen = 0;
+    if ( argc == 3 && strcmp( argv[ 1 ], REPLAY_OPT ) == 0 ) {
+        log = mapLog( argv[ 2 ], &logLen );
+        setPrompts( false );
+    } else if ( argc != 1 ) {
+        fprintf( stderr, "usage: contest [--replay <event-log>]\n" );
+        exit( EXIT_FAILURE );
+    }
+
     Contest *contest = makeContest();
-    while ( !feof( stdin ) ) {
+    while ( !commandsEnded() ) {
         if ( !processCommand( contest ) ) {
-            printf( "\nInvalid command" );
+            output( "\nInvalid command" );
         }
-        if ( !feof( stdin ) ) {
-            printf( "\n" );
+        if ( !commandsEnded() ) {
+            output( "\n" );
         }
     }
+    flushOutput();
+    closeLog();
     freeContest( contest );
+    if ( log ) {
+        munmap( log, logLen );
+    }
     return EXIT_SUCCESS;
 }
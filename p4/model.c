@@ -10,11 +10,146 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stddef.h>
+#include <stdint.h>
 #include "model.h"
 
 /** Initial capacity of an array. */
 #define INITIAL_CAPACITY 3
 
+/** Value of a penalty for an attempt. */
+#define PENALTY_AMT 20
+
+/** Number of bits in each byte of a bitmap. */
+#define BITS_PER_BYTE 8
+
+/** Initial number of slots in a hash index, a power of two. */
+#define INITIAL_INDEX 8
+
+/** Offset basis and prime for the FNV-1a hash. */
+#define FNV_BASIS 2166136261u
+#define FNV_PRIME 16777619u
+
+/**
+   Orders problems by their difficulty rating.
+
+   @param problem1 first problem to be ordered.
+   @param problem2 second problem to be ordered.
+   @return -1 if problem1 comes before problem2, 1 if problem1 comes after problem2,
+            or 0 if problem1 is equal to problem2.
+ */
+static int pComp( const void *problem1, const void *problem2 )
+{
+    Problem const *p1 = (Problem const *) problem1;
+    Problem const *p2 = (Problem const *) problem2;
+    if ( p1->sCount > p2->sCount ) {
+        return -1;
+    } else if ( p1->sCount < p2->sCount ) {
+        return 1;
+    } else {
+        if ( p1->aCount < p2->aCount ) {
+            return -1;
+        } else if ( p1->aCount > p2->aCount ) {
+            return 1;
+        } else {
+            return strcmp( p1->id, p2->id );
+        }
+    }
+}
+
+/**
+   Orders contestants by their difficulty rating.
+
+   @param contestant1 first contestant to be ordered.
+   @param contestant2 second contestant to be ordered.
+   @return -1 if contestant1 comes before contestant2, 1 if contestant1 comes after.
+            contestant2, or 0 if contestant1 is equal to contestant2.
+ */
+static int cComp( const void *contestant1, const void *contestant2 )
+{
+    Contestant const *c1 = (Contestant const *) contestant1;
+    Contestant const *c2 = (Contestant const *) contestant2;
+    if ( c1->sCount > c2->sCount ) {
+        return -1;
+    } else if ( c1->sCount < c2->sCount ) {
+        return 1;
+    } else {
+        if ( c1->penalty < c2->penalty ) {
+            return -1;
+        } else if ( c1->penalty > c2->penalty ) {
+            return 1;
+        } else {
+            return strcmp( c1->id, c2->id );
+        }
+    }
+}
+
+/**
+   Hashes an id with FNV-1a.
+
+   @param id id to hash.
+   @return hash of the id.
+ */
+static uint32_t hashId( char const *id )
+{
+    uint32_t hash = FNV_BASIS;
+    for ( ; *id; id++ ) {
+        hash = ( hash ^ (unsigned char) *id ) * FNV_PRIME;
+    }
+    return hash;
+}
+
+/**
+   Finds the slot of a hash index holding the item with the given id, or the empty
+   slot where it would go, by linear probing. The index can hold either problems or
+   contestants; the id of an item is found at idOffset bytes from its start.
+
+   @param index slots of the index.
+   @param cap number of slots, a power of two.
+   @param id id to look for.
+   @param idOffset offset of the id field in each item.
+   @return index of the slot.
+ */
+static int findSlot( void **index, int cap, char const *id, size_t idOffset )
+{
+    int slot = hashId( id ) & ( cap - 1 );
+    while ( index[ slot ]
+            && strcmp( (char const *) index[ slot ] + idOffset, id ) != 0 ) {
+        slot = ( slot + 1 ) & ( cap - 1 );
+    }
+    return slot;
+}
+
+/**
+   Adds an item to a hash index, doubling the number of slots first if the index
+   would become more than half full.
+
+   @param index pointer to the slots of the index, which may be replaced.
+   @param cap pointer to the number of slots.
+   @param count number of items in the index, counting the new one.
+   @param item item to add.
+   @param idOffset offset of the id field in each item.
+ */
+static void addToIndex( void ***index, int *cap, int count, void *item,
+                        size_t idOffset )
+{
+    if ( count * 2 > *cap ) {
+        int oldCap = *cap;
+        void **old = *index;
+        *cap = oldCap * 2;
+        *index = (void **) calloc( *cap, sizeof( void * ) );
+        for ( int i = 0; i < oldCap; i++ ) {
+            if ( old[ i ] ) {
+                char const *id = (char const *) old[ i ] + idOffset;
+                ( *index )[ findSlot( *index, *cap, id, idOffset ) ] = old[ i ];
+            }
+        }
+        free( old );
+    }
+    char const *id = (char const *) item + idOffset;
+    ( *index )[ findSlot( *index, *cap, id, idOffset ) ] = item;
+}
+
 Problem *makeProblem( char const *id, char const *name )
 {
     Problem *problem = (Problem *) malloc( sizeof( Problem ) );
@@ -22,6 +157,7 @@ Problem *makeProblem( char const *id, char const *name )
     strcpy( problem->name, name );
     problem->aCount = 0;
     problem->sCount = 0;
+    problem->index = 0;
     return problem;
 }
 
@@ -40,12 +176,18 @@ Contestant *makeContestant( char const *id, char const *name )
     contestant->sCount = 0;
     contestant->penalty = 0;
     contestant->aList = (Attempt *) malloc( contestant->aCap * sizeof( Attempt ) );
+    contestant->solvedBits = NULL;
+    contestant->tries = NULL;
+    contestant->pCap = 0;
+    contestant->index = 0;
     return contestant;
 }
 
 void freeContestant( Contestant *contestant )
 {
     free( contestant->aList );
+    free( contestant->solvedBits );
+    free( contestant->tries );
     free( contestant );
 }
 
@@ -58,6 +200,12 @@ Contest *makeContest()
     contest->cCount = 0;
     contest->cCap = INITIAL_CAPACITY;
     contest->cList = (Contestant **) malloc( contest->cCap * sizeof( Contestant * ) );
+    contest->pIndexCap = INITIAL_INDEX;
+    contest->pIndex = (void **) calloc( contest->pIndexCap, sizeof( void * ) );
+    contest->cIndexCap = INITIAL_INDEX;
+    contest->cIndex = (void **) calloc( contest->cIndexCap, sizeof( void * ) );
+    contest->pBoard = makeBoard( pComp );
+    contest->cBoard = makeBoard( cComp );
     return contest;
 }
 
@@ -71,25 +219,156 @@ void freeContest( Contest *contest )
         freeContestant( contest->cList[ i ] );
     }
     free( contest->cList );
+    free( contest->pIndex );
+    free( contest->cIndex );
+    freeBoard( contest->pBoard );
+    freeBoard( contest->cBoard );
     free( contest );
 }
 
-Problem *findProblem( Contest *contest, char const *id )
+void addProblem( Contest *contest, Problem *problem )
 {
-    for ( int i = 0; i < contest->pCount; i++ ) {
-        if ( strcmp( id, contest->pList[ i ]->id ) == 0 ) {
-            return contest->pList[ i ];
-        }
+    if ( contest->pCount + 1 >= contest->pCap ) {
+        contest->pCap *= 2;
+        contest->pList = (Problem **) realloc( contest->pList,
+                            contest->pCap * sizeof( Problem * ) );
     }
-    return NULL;
+    problem->index = contest->pCount;
+    contest->pList[ contest->pCount ] = problem;
+    contest->pCount++;
+    addToIndex( &contest->pIndex, &contest->pIndexCap, contest->pCount, problem,
+                offsetof( Problem, id ) );
+    boardInsert( contest->pBoard, problem );
 }
 
-Contestant *findContestant( Contest *contest, char const *id )
+void addContestant( Contest *contest, Contestant *contestant )
 {
-    for ( int i = 0; i < contest->cCount; i++ ) {
-        if ( strcmp( id, contest->cList[ i ]->id ) == 0 ) {
-            return contest->cList[ i ];
-        }
+    if ( contest->cCount + 1 >= contest->cCap ) {
+        contest->cCap *= 2;
+        contest->cList = (Contestant **) realloc( contest->cList,
+                            contest->cCap * sizeof( Contestant * ) );
+    }
+    contestant->index = contest->cCount;
+    contest->cList[ contest->cCount ] = contestant;
+    contest->cCount++;
+    addToIndex( &contest->cIndex, &contest->cIndexCap, contest->cCount, contestant,
+                offsetof( Contestant, id ) );
+    boardInsert( contest->cBoard, contestant );
+}
+
+/**
+   Makes sure a contestant's per-problem arrays have room for the given problem,
+   growing them with zeros for the problems they didn't cover.
+
+   @param contestant contestant whose arrays may need to grow.
+   @param problem problem the arrays need to cover.
+ */
+static void coverProblem( Contestant *contestant, Problem const *problem )
+{
+    if ( problem->index < contestant->pCap ) {
+        return;
+    }
+    int oldCap = contestant->pCap;
+    int cap = oldCap ? oldCap * 2 : BITS_PER_BYTE;
+    while ( problem->index >= cap ) {
+        cap *= 2;
+    }
+    contestant->solvedBits = (unsigned char *) realloc( contestant->solvedBits,
+                                 cap / BITS_PER_BYTE );
+    memset( contestant->solvedBits + oldCap / BITS_PER_BYTE, 0,
+            ( cap - oldCap ) / BITS_PER_BYTE );
+    contestant->tries = (int *) realloc( contestant->tries, cap * sizeof( int ) );
+    memset( contestant->tries + oldCap, 0, ( cap - oldCap ) * sizeof( int ) );
+    contestant->pCap = cap;
+}
+
+/**
+   Adds an attempt to the end of a contestant's list of attempts.
+
+   @param contestant contestant making the attempt.
+   @param problem problem attempted.
+   @param solved true if the attempt was successful.
+ */
+static void addAttempt( Contestant *contestant, Problem *problem, bool solved )
+{
+    if ( contestant->aCount + 1 >= contestant->aCap ) {
+        contestant->aCap *= 2;
+        contestant->aList = (Attempt *) realloc( contestant->aList,
+                                contestant->aCap * sizeof( Attempt ) );
+    }
+    contestant->aList[ contestant->aCount ].problem = problem;
+    contestant->aList[ contestant->aCount ].solved = solved;
+    contestant->aCount++;
+}
+
+bool hasSolved( Contestant const *contestant, Problem const *problem )
+{
+    int i = problem->index;
+    return i < contestant->pCap
+        && ( contestant->solvedBits[ i / BITS_PER_BYTE ]
+             >> ( i % BITS_PER_BYTE ) & 1 );
+}
+
+void recordAttempt( Contest *contest, Contestant *contestant, Problem *problem )
+{
+    if ( hasSolved( contestant, problem ) ) {
+        return;
+    }
+    coverProblem( contestant, problem );
+    contestant->tries[ problem->index ]++;
+    boardRemove( contest->pBoard, problem );
+    addAttempt( contestant, problem, false );
+    problem->aCount++;
+    boardInsert( contest->pBoard, problem );
+}
+
+void recordSolved( Contest *contest, Contestant *contestant, Problem *problem )
+{
+    coverProblem( contestant, problem );
+    int i = problem->index;
+    bool solved = hasSolved( contestant, problem );
+    if ( solved && contestant->tries[ i ] == 0 ) {
+        return;
+    }
+
+    // The contestant's place changes with the penalty, even if the problem was
+    // solved already; the problem's place changes only if it wasn't.
+    boardRemove( contest->cBoard, contestant );
+    contestant->penalty += contestant->tries[ i ] * PENALTY_AMT;
+    if ( !solved ) {
+        boardRemove( contest->pBoard, problem );
+        contestant->solvedBits[ i / BITS_PER_BYTE ] |= 1 << ( i % BITS_PER_BYTE );
+        addAttempt( contestant, problem, true );
+        contestant->sCount++;
+        problem->aCount++;
+        problem->sCount++;
+        boardInsert( contest->pBoard, problem );
+    }
+    boardInsert( contest->cBoard, contestant );
+}
+
+void restoreAttempt( Contestant *contestant, Problem *problem, bool solved )
+{
+    coverProblem( contestant, problem );
+    int i = problem->index;
+    if ( solved ) {
+        contestant->solvedBits[ i / BITS_PER_BYTE ] |= 1 << ( i % BITS_PER_BYTE );
+    } else {
+        contestant->tries[ i ]++;
     }
-    return NULL;
+    addAttempt( contestant, problem, solved );
+}
+
+Problem *findProblem( Contest *contest, char const *id )
+{
+    void **index = contest->pIndex;
+    return (Problem *) index[ findSlot( index, contest->pIndexCap, id,
+                                        offsetof( Problem, id ) ) ];
+}
+
+Contestant *findContestant( Contest *contest, char const *id )
+{
+    void **index = contest->cIndex;
+    return (Contestant *) index[ findSlot( index, contest->cIndexCap, id,
+                                           offsetof( Contestant, id ) ) ];
 }
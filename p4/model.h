@@ -6,6 +6,7 @@
  */
 
 #include <stdbool.h>
+#include "board.h"
 
 /** Maximum length of a person or problem unique id. */
 #define MAX_ID 16
@@ -26,6 +27,10 @@ typedef struct {
 
   /** Number of successful attempts. */
   int sCount;
+
+  /** Position of this problem in the order problems were added, used to find its
+      entries in each contestant's per-problem arrays. */
+  int index;
 } Problem;
 
 /** Record for an attempt to solve a problem. */
@@ -59,6 +64,19 @@ typedef struct {
 
   /** Total number of penalty points. */
   int penalty;
+
+  /** Bitmap of the problems this contestant has solved, one bit per problem
+      index. */
+  unsigned char *solvedBits;
+
+  /** Number of unsuccessful attempts at each problem, by problem index. */
+  int *tries;
+
+  /** Number of problems solvedBits and tries have room for, a multiple of 8. */
+  int pCap;
+
+  /** Position of this contestant in the order contestants were added. */
+  int index;
 } Contestant;
 
 /** Representation for the whole contest, containing a resizable list of problmes
@@ -81,6 +99,28 @@ typedef struct {
 
   /** Capacity of the current cList array. */
   int cCap;
+
+  /** Hash index of the problems by id, using open addressing, so a problem can be
+      found without scanning pList. Empty slots are NULL. The slots are generic
+      pointers, since the same code indexes problems and contestants. */
+  void **pIndex;
+
+  /** Number of slots in pIndex, a power of two at least twice pCount. */
+  int pIndexCap;
+
+  /** Hash index of the contestants by id, like pIndex. */
+  void **cIndex;
+
+  /** Number of slots in cIndex. */
+  int cIndexCap;
+
+  /** Problems in the order they're listed: most solutions first, then fewest
+      attempts, then by id. */
+  Board *pBoard;
+
+  /** Contestants in the order they're listed: most problems solved first, then
+      least penalty, then by id. */
+  Board *cBoard;
 } Contest;
 
 /**
@@ -139,9 +179,71 @@ Contest *makeContest();
  */
 void freeContest( Contest *contest );
 
+/**
+   This adds a problem to the end of the contest's problem list, to its index by id
+   and to its ranking, growing them if necessary. There shouldn't already be a
+   problem with the same id.
+
+   @param contest contest to add the problem to.
+   @param problem dynamically allocated problem, which the contest will free.
+ */
+void addProblem( Contest *contest, Problem *problem );
+
+/**
+   This adds a contestant to the end of the contest's contestant list, to its index
+   by id and to its ranking, growing them if necessary. There shouldn't already be a
+   contestant with the same id.
+
+   @param contest contest to add the contestant to.
+   @param contestant dynamically allocated contestant, which the contest will free.
+ */
+void addContestant( Contest *contest, Contestant *contestant );
+
+/**
+   This reports whether a contestant has solved a problem, in constant time.
+
+   @param contestant contestant to check.
+   @param problem problem to check for.
+   @return true if the contestant has solved the problem.
+ */
+bool hasSolved( Contestant const *contestant, Problem const *problem );
+
+/**
+   This records an unsuccessful attempt by a contestant at a problem. Attempts at a
+   problem the contestant has already solved are ignored.
+
+   @param contest contest the problem is listed in.
+   @param contestant contestant making the attempt.
+   @param problem problem attempted.
+ */
+void recordAttempt( Contest *contest, Contestant *contestant, Problem *problem );
+
+/**
+   This records a successful attempt by a contestant at a problem. The contestant is
+   charged a penalty for each earlier unsuccessful attempt at the problem, but the
+   attempt itself is only counted if the problem wasn't solved already.
+
+   @param contest contest the contestant and problem are listed in.
+   @param contestant contestant making the attempt.
+   @param problem problem solved.
+ */
+void recordSolved( Contest *contest, Contestant *contestant, Problem *problem );
+
+/**
+   This restores one of a contestant's attempts from a saved copy of the contest. It
+   updates the contestant's attempt list and per-problem records, but not the counts
+   kept for the contestant and the problem, since those are restored separately.
+
+   @param contestant contestant who made the attempt.
+   @param problem problem attempted.
+   @param solved true if the attempt was successful.
+ */
+void restoreAttempt( Contestant *contestant, Problem *problem, bool solved );
+
 /**
    Given a contest and a problem ID, this function returns a pointer to the problem
-   with that ID, or NULL if it doesn't exist.
+   with that ID, or NULL if it doesn't exist. It looks the id up in the contest's
+   hash index, so it takes constant time on average.
 
    @param contest contest associated with the problem to be found.
    @param id id associated with the problem to be found.
@@ -151,7 +253,8 @@ Problem *findProblem( Contest *contest, char const *id );
 
 /**
    Given a contest and a contestant ID, this function returns a pointer to the
-   contestant with that ID, or NULL if it doesn't exist.
+   contestant with that ID, or NULL if it doesn't exist. Like findProblem(), it uses
+   the contest's hash index.
 
    @param contest contest associated with the contestant to be found.
    @param id id associated with the contestant to be found.
@@ -0,0 +1,528 @@
+/**
+   @file snapshot.c
+   @author Selena Chen (schen53)
+
+   This component saves the contest to a binary snapshot and restores it, so a
+   restarted contest doesn't have to replay every command from the start.
+
+   A snapshot is a header followed by fixed-size records: one for each problem, in
+   the order they were added, one for each contestant, in the same kind of order,
+   and one for each attempt, grouped by contestant. The counts in the header give
+   the exact size of the file, so it can be checked and then mapped and read in
+   place, without any parsing beyond copying the fields out.
+
+   Changes made after a snapshot is saved go into an append-only event log next to
+   it, one fixed-size record per change. The log header repeats a stamp from the
+   snapshot header, so a log left over from an older snapshot is never applied to a
+   newer one. A record only partly written when the program stopped is dropped.
+
+   Records are written as they're laid out in memory, in the host's byte order, so
+   a snapshot and its log can only be read on the kind of machine that wrote them.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "model.h"
+#include "snapshot.h"
+
+/** Identifying bytes at the start of a snapshot and of an event log. */
+#define SNAPSHOT_MAGIC "CONTSNAP"
+#define LOG_MAGIC "CONTELOG"
+#define MAGIC_SIZE 8
+
+/** Version of the snapshot and log formats, changed whenever their layout does. */
+#define FORMAT_VERSION 1
+
+/** Suffixes added to a snapshot's name for its temporary copy and its event log. */
+#define TEMP_SUFFIX ".tmp"
+#define LOG_SUFFIX ".log"
+
+/** Number of low-order bits of a stamp taken from the process id. */
+#define STAMP_PID_BITS 20
+
+/** Kinds of event log records. */
+typedef enum { LOG_PROBLEM, LOG_CONTESTANT, LOG_ATTEMPT, LOG_SOLVED } RecordType;
+
+/** Header at the start of a snapshot. */
+typedef struct {
+    /** SNAPSHOT_MAGIC, without a null terminator. */
+    char magic[ MAGIC_SIZE ];
+
+    /** FORMAT_VERSION. */
+    uint32_t version;
+
+    /** Number of problem, contestant and attempt records that follow. */
+    uint32_t pCount;
+    uint32_t cCount;
+    uint32_t aCount;
+
+    /** Value identifying this snapshot, repeated in its event log. */
+    uint64_t stamp;
+} SnapshotHeader;
+
+/** Snapshot record for a problem or a contestant. */
+typedef struct {
+    /** Its id and name, null-terminated and padded with zeros. */
+    char id[ MAX_ID + 1 ];
+    char name[ MAX_NAME + 1 ];
+
+    /** Number of attempts, and of successful ones. For a contestant, aCount is also
+        the number of attempt records that belong to it. */
+    int32_t aCount;
+    int32_t sCount;
+
+    /** Penalty points, for a contestant. */
+    int32_t penalty;
+} Entry;
+
+/** Snapshot record for an attempt. */
+typedef struct {
+    /** Index of the problem attempted. */
+    int32_t problem;
+
+    /** Nonzero if the attempt was successful. */
+    int32_t solved;
+} SavedAttempt;
+
+/** Header at the start of an event log. */
+typedef struct {
+    /** LOG_MAGIC, without a null terminator. */
+    char magic[ MAGIC_SIZE ];
+
+    /** FORMAT_VERSION. */
+    uint32_t version;
+
+    /** Always zero. */
+    uint32_t reserved;
+
+    /** Stamp of the snapshot this log belongs to. */
+    uint64_t stamp;
+} LogHeader;
+
+/** Event log record for one change to the contest. */
+typedef struct {
+    /** Kind of change, a RecordType. */
+    int32_t type;
+
+    /** Indexes of the contestant and problem, for an attempt. */
+    int32_t contestant;
+    int32_t problem;
+
+    /** Id and name of a new problem or contestant. */
+    char id[ MAX_ID + 1 ];
+    char name[ MAX_NAME + 1 ];
+} Record;
+
+/** Event log changes are being added to, or NULL. */
+static FILE *logFile = NULL;
+
+/** Stamp of the most recently saved snapshot. */
+static uint64_t lastStamp = 0;
+
+/**
+   Makes a copy of a file name with a suffix added.
+
+   @param filename name to add to.
+   @param suffix suffix to add.
+   @return dynamically allocated name.
+ */
+static char *addSuffix( char const *filename, char const *suffix )
+{
+    char *name = (char *) malloc( strlen( filename ) + strlen( suffix ) + 1 );
+    strcpy( name, filename );
+    strcat( name, suffix );
+    return name;
+}
+
+/**
+   Maps a whole file into memory for reading.
+
+   @param filename name of the file.
+   @param len pointer to where the length of the file should be stored.
+   @return start of the mapping, or NULL if the file can't be mapped or is empty.
+ */
+static unsigned char *mapFile( char const *filename, size_t *len )
+{
+    int fd = open( filename, O_RDONLY );
+    if ( fd < 0 ) {
+        return NULL;
+    }
+    struct stat st;
+    void *map = NULL;
+    if ( fstat( fd, &st ) == 0 && st.st_size > 0 ) {
+        *len = st.st_size;
+        map = mmap( NULL, *len, PROT_READ, MAP_PRIVATE, fd, 0 );
+        map = map == MAP_FAILED ? NULL : map;
+    }
+    close( fd );
+    return (unsigned char *) map;
+}
+
+/**
+   Checks that the id and name of a snapshot entry or log record are null-terminated
+   and that the id isn't empty.
+
+   @param id id field to check.
+   @param name name field to check.
+   @return true if they're valid.
+ */
+static bool validNames( char const *id, char const *name )
+{
+    return id[ 0 ] != '\0' && id[ MAX_ID ] == '\0' && name[ MAX_NAME ] == '\0';
+}
+
+/**
+   Fills in the part of a snapshot entry or log record holding an id and name,
+   zeroing the unused bytes so saved files don't depend on leftover memory.
+
+   @param id id field to fill in.
+   @param name name field to fill in.
+   @param srcId id to store.
+   @param srcName name to store.
+ */
+static void putNames( char *id, char *name, char const *srcId, char const *srcName )
+{
+    strncpy( id, srcId, MAX_ID + 1 );
+    strncpy( name, srcName, MAX_NAME + 1 );
+}
+
+/**
+   Creates a new, empty event log for a snapshot, replacing any file already there.
+
+   @param path name of the event log.
+   @param stamp stamp of the snapshot.
+   @return the log, open for adding records, or NULL if it couldn't be created.
+ */
+static FILE *createLog( char const *path, uint64_t stamp )
+{
+    FILE *fp = fopen( path, "wb" );
+    if ( !fp ) {
+        return NULL;
+    }
+    LogHeader header;
+    memset( &header, 0, sizeof( header ) );
+    memcpy( header.magic, LOG_MAGIC, MAGIC_SIZE );
+    header.version = FORMAT_VERSION;
+    header.stamp = stamp;
+    fwrite( &header, sizeof( header ), 1, fp );
+    if ( fflush( fp ) != 0 ) {
+        fclose( fp );
+        remove( path );
+        return NULL;
+    }
+    return fp;
+}
+
+/**
+   Adds a record to the event log, if there is one, and writes it out right away, so
+   it survives the program stopping.
+
+   @param record record to add.
+ */
+static void writeRecord( Record const *record )
+{
+    if ( logFile ) {
+        fwrite( record, sizeof( Record ), 1, logFile );
+        fflush( logFile );
+    }
+}
+
+bool saveSnapshot( Contest *contest, char const *filename )
+{
+    char *temp = addSuffix( filename, TEMP_SUFFIX );
+    FILE *fp = fopen( temp, "wb" );
+    if ( !fp ) {
+        free( temp );
+        return false;
+    }
+
+    // Stamps only have to differ between snapshots that could share a log name.
+    uint64_t stamp = (uint64_t) time( NULL ) << STAMP_PID_BITS
+                     | ( getpid() & ( ( 1 << STAMP_PID_BITS ) - 1 ) );
+    stamp = stamp > lastStamp ? stamp : lastStamp + 1;
+    lastStamp = stamp;
+
+    SnapshotHeader header;
+    memset( &header, 0, sizeof( header ) );
+    memcpy( header.magic, SNAPSHOT_MAGIC, MAGIC_SIZE );
+    header.version = FORMAT_VERSION;
+    header.pCount = contest->pCount;
+    header.cCount = contest->cCount;
+    for ( int i = 0; i < contest->cCount; i++ ) {
+        header.aCount += contest->cList[ i ]->aCount;
+    }
+    header.stamp = stamp;
+    fwrite( &header, sizeof( header ), 1, fp );
+
+    Entry entry;
+    for ( int i = 0; i < contest->pCount; i++ ) {
+        Problem *problem = contest->pList[ i ];
+        memset( &entry, 0, sizeof( entry ) );
+        putNames( entry.id, entry.name, problem->id, problem->name );
+        entry.aCount = problem->aCount;
+        entry.sCount = problem->sCount;
+        fwrite( &entry, sizeof( entry ), 1, fp );
+    }
+    for ( int i = 0; i < contest->cCount; i++ ) {
+        Contestant *contestant = contest->cList[ i ];
+        memset( &entry, 0, sizeof( entry ) );
+        putNames( entry.id, entry.name, contestant->id, contestant->name );
+        entry.aCount = contestant->aCount;
+        entry.sCount = contestant->sCount;
+        entry.penalty = contestant->penalty;
+        fwrite( &entry, sizeof( entry ), 1, fp );
+    }
+    for ( int i = 0; i < contest->cCount; i++ ) {
+        Contestant *contestant = contest->cList[ i ];
+        for ( int j = 0; j < contestant->aCount; j++ ) {
+            SavedAttempt attempt = { contestant->aList[ j ].problem->index,
+                                     contestant->aList[ j ].solved };
+            fwrite( &attempt, sizeof( attempt ), 1, fp );
+        }
+    }
+
+    // Make sure the snapshot is complete on disk, and its new log is ready, before
+    // it replaces the old one. Until then, changes still go to the old log.
+    bool ok = !ferror( fp ) && fflush( fp ) == 0 && fsync( fileno( fp ) ) == 0;
+    ok = fclose( fp ) == 0 && ok;
+    char *path = addSuffix( filename, LOG_SUFFIX );
+    char *tempLog = addSuffix( path, TEMP_SUFFIX );
+    FILE *log = ok ? createLog( tempLog, stamp ) : NULL;
+    ok = log && rename( temp, filename ) == 0;
+    if ( !ok ) {
+        if ( log ) {
+            fclose( log );
+            remove( tempLog );
+        }
+        remove( temp );
+    } else {
+        // A crash before the log is renamed leaves the old log, which doesn't match
+        // the new snapshot's stamp, so it's ignored.
+        closeLog();
+        logFile = log;
+        ok = rename( tempLog, path ) == 0;
+    }
+    free( tempLog );
+    free( path );
+    free( temp );
+    return ok;
+}
+
+/**
+   Builds a contest from a mapped snapshot, checking everything in it along the way.
+
+   @param contest empty contest to fill in.
+   @param map start of the snapshot.
+   @param len length of the snapshot.
+   @param stamp pointer to where the snapshot's stamp should be stored.
+   @return true if the snapshot was valid.
+ */
+static bool readSnapshot( Contest *contest, unsigned char const *map, size_t len,
+                          uint64_t *stamp )
+{
+    SnapshotHeader const *header = (SnapshotHeader const *) map;
+    if ( len < sizeof( SnapshotHeader )
+         || memcmp( header->magic, SNAPSHOT_MAGIC, MAGIC_SIZE )
+         || header->version != FORMAT_VERSION || header->pCount > INT32_MAX
+         || header->cCount > INT32_MAX ) {
+        return false;
+    }
+    uint64_t size = sizeof( SnapshotHeader )
+                    + ( (uint64_t) header->pCount + header->cCount ) * sizeof( Entry )
+                    + (uint64_t) header->aCount * sizeof( SavedAttempt );
+    if ( size != len ) {
+        return false;
+    }
+    *stamp = header->stamp;
+
+    Entry const *entries = (Entry const *) ( header + 1 );
+    for ( uint32_t i = 0; i < header->pCount; i++ ) {
+        Entry const *entry = entries + i;
+        if ( !validNames( entry->id, entry->name )
+             || findProblem( contest, entry->id ) ) {
+            return false;
+        }
+        Problem *problem = makeProblem( entry->id, entry->name );
+        problem->aCount = entry->aCount;
+        problem->sCount = entry->sCount;
+        addProblem( contest, problem );
+    }
+
+    // Counts are set before adding each problem and contestant, so they're ranked
+    // in the right place.
+    SavedAttempt const *attempts = (SavedAttempt const *) ( entries + header->pCount
+                                                              + header->cCount );
+    uint32_t next = 0;
+    for ( uint32_t i = 0; i < header->cCount; i++ ) {
+        Entry const *entry = entries + header->pCount + i;
+        if ( !validNames( entry->id, entry->name )
+             || findContestant( contest, entry->id ) || entry->aCount < 0
+             || (uint32_t) entry->aCount > header->aCount - next ) {
+            return false;
+        }
+        Contestant *contestant = makeContestant( entry->id, entry->name );
+        contestant->sCount = entry->sCount;
+        contestant->penalty = entry->penalty;
+        for ( int j = 0; j < entry->aCount; j++, next++ ) {
+            int32_t p = attempts[ next ].problem;
+            if ( p < 0 || p >= contest->pCount ) {
+                freeContestant( contestant );
+                return false;
+            }
+            restoreAttempt( contestant, contest->pList[ p ],
+                            attempts[ next ].solved );
+        }
+        addContestant( contest, contestant );
+    }
+    return next == header->aCount;
+}
+
+/**
+   Applies one event log record to a contest.
+
+   @param contest contest to change.
+   @param record record to apply.
+   @return true if the record was valid.
+ */
+static bool applyRecord( Contest *contest, Record const *record )
+{
+    if ( record->type == LOG_PROBLEM ) {
+        if ( !validNames( record->id, record->name )
+             || findProblem( contest, record->id ) ) {
+            return false;
+        }
+        addProblem( contest, makeProblem( record->id, record->name ) );
+    } else if ( record->type == LOG_CONTESTANT ) {
+        if ( !validNames( record->id, record->name )
+             || findContestant( contest, record->id ) ) {
+            return false;
+        }
+        addContestant( contest, makeContestant( record->id, record->name ) );
+    } else if ( record->type == LOG_ATTEMPT || record->type == LOG_SOLVED ) {
+        if ( record->contestant < 0 || record->contestant >= contest->cCount
+             || record->problem < 0 || record->problem >= contest->pCount ) {
+            return false;
+        }
+        Contestant *contestant = contest->cList[ record->contestant ];
+        Problem *problem = contest->pList[ record->problem ];
+        if ( record->type == LOG_SOLVED ) {
+            recordSolved( contest, contestant, problem );
+        } else {
+            recordAttempt( contest, contestant, problem );
+        }
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/**
+   Applies the event log of a snapshot that's just been loaded, and opens it so more
+   changes can be added. Anything after the last complete, valid record is cut off.
+   If the log is missing or belongs to another snapshot, a new one is started.
+
+   @param contest contest loaded from the snapshot.
+   @param filename name of the snapshot file.
+   @param stamp stamp of the snapshot.
+ */
+static void replayLog( Contest *contest, char const *filename, uint64_t stamp )
+{
+    char *path = addSuffix( filename, LOG_SUFFIX );
+    size_t len = 0;
+    unsigned char *map = mapFile( path, &len );
+    size_t keep = 0;
+    LogHeader const *header = (LogHeader const *) map;
+    if ( map && len >= sizeof( LogHeader )
+         && memcmp( header->magic, LOG_MAGIC, MAGIC_SIZE ) == 0
+         && header->version == FORMAT_VERSION && header->stamp == stamp ) {
+        keep = sizeof( LogHeader );
+        Record const *records = (Record const *) ( header + 1 );
+        size_t count = ( len - sizeof( LogHeader ) ) / sizeof( Record );
+        for ( size_t i = 0; i < count && applyRecord( contest, records + i ); i++ ) {
+            keep += sizeof( Record );
+        }
+    }
+    if ( map ) {
+        munmap( map, len );
+    }
+
+    closeLog();
+    if ( keep > 0 && truncate( path, keep ) == 0 ) {
+        logFile = fopen( path, "ab" );
+    } else {
+        logFile = createLog( path, stamp );
+    }
+    free( path );
+}
+
+bool loadSnapshot( Contest *contest, char const *filename )
+{
+    size_t len = 0;
+    unsigned char *map = mapFile( filename, &len );
+    if ( !map ) {
+        return false;
+    }
+    Contest *loaded = makeContest();
+    uint64_t stamp;
+    bool ok = readSnapshot( loaded, map, len, &stamp );
+    munmap( map, len );
+    if ( !ok ) {
+        freeContest( loaded );
+        return false;
+    }
+
+    // Trade contents with the loaded contest, so the caller's pointer stays valid
+    // and the old contents are freed with it.
+    Contest old = *contest;
+    *contest = *loaded;
+    *loaded = old;
+    freeContest( loaded );
+
+    replayLog( contest, filename, stamp );
+    return true;
+}
+
+void logProblem( Problem const *problem )
+{
+    Record record;
+    memset( &record, 0, sizeof( record ) );
+    record.type = LOG_PROBLEM;
+    putNames( record.id, record.name, problem->id, problem->name );
+    writeRecord( &record );
+}
+
+void logContestant( Contestant const *contestant )
+{
+    Record record;
+    memset( &record, 0, sizeof( record ) );
+    record.type = LOG_CONTESTANT;
+    putNames( record.id, record.name, contestant->id, contestant->name );
+    writeRecord( &record );
+}
+
+void logAttempt( Contestant const *contestant, Problem const *problem, bool solved )
+{
+    Record record;
+    memset( &record, 0, sizeof( record ) );
+    record.type = solved ? LOG_SOLVED : LOG_ATTEMPT;
+    record.contestant = contestant->index;
+    record.problem = problem->index;
+    writeRecord( &record );
+}
+
+void closeLog( void )
+{
+    if ( logFile ) {
+        fclose( logFile );
+        logFile = NULL;
+    }
+}
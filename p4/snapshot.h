@@ -0,0 +1,64 @@
+/**
+   @file snapshot.h
+   @author Selena Chen (schen53)
+
+   Contains function prototypes for snapshot.c.
+ */
+
+/**
+   This saves the whole contest to a binary snapshot file, and starts a new event
+   log next to it, named after the snapshot with .log added. From then on, every
+   change to the contest should be passed to the log functions below, so loading the
+   snapshot brings back the contest as it was at the latest change. The snapshot is
+   written to a temporary file first and renamed, so a crash never leaves a partly
+   written snapshot behind. If the snapshot can't be saved, changes keep going to
+   the log they were going to before.
+
+   Snapshots and logs hold native structures in the host's byte order, so they can
+   only be loaded on the kind of machine that saved them.
+
+   @param contest contest to save.
+   @param filename name of the snapshot file.
+   @return true if the snapshot was saved.
+ */
+bool saveSnapshot( Contest *contest, char const *filename );
+
+/**
+   This replaces the contents of a contest with a saved snapshot, then applies the
+   changes recorded in its event log since it was saved. Further changes are added
+   to the same log. If the snapshot can't be read or isn't valid, the contest is
+   left unchanged.
+
+   @param contest contest to replace.
+   @param filename name of the snapshot file.
+   @return true if the snapshot was loaded.
+ */
+bool loadSnapshot( Contest *contest, char const *filename );
+
+/**
+   This adds a new problem to the event log, if there is one.
+
+   @param problem problem added to the contest.
+ */
+void logProblem( Problem const *problem );
+
+/**
+   This adds a new contestant to the event log, if there is one.
+
+   @param contestant contestant added to the contest.
+ */
+void logContestant( Contestant const *contestant );
+
+/**
+   This adds an attempt to the event log, if there is one.
+
+   @param contestant contestant making the attempt.
+   @param problem problem attempted.
+   @param solved true if the attempt was successful.
+ */
+void logAttempt( Contestant const *contestant, Problem const *problem, bool solved );
+
+/**
+   This closes the event log, if there is one.
+ */
+void closeLog( void );
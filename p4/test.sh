@@ -31,6 +31,35 @@ testProgram() {
   return 0
 }
 
+# Function to replay a test case's input as an event log and check
+# that the output matches the expected output without the prompts
+testReplay() {
+  TESTNO=$1
+
+  rm -f output.txt expected.txt
+
+  echo "Replay test $TESTNO: ./contest --replay input-$TESTNO.txt > output.txt 2>&1"
+  ./contest --replay input-$TESTNO.txt > output.txt 2>&1
+  STATUS=$?
+
+  if [ $STATUS -ne 0 ]; then
+      echo "**** Replay test $TESTNO FAILED - incorrect exit status"
+      FAIL=1
+      return 1
+  fi
+
+  sed -E 's/^[0-9]+> //' expected-$TESTNO.txt > expected.txt
+  if ! diff -q expected.txt output.txt >/dev/null 2>&1
+  then
+      echo "**** Replay test $TESTNO FAILED - output didn't match the expected output"
+      FAIL=1
+      return 1
+  fi
+
+  echo "Replay test $TESTNO PASS"
+  return 0
+}
+
 # make a fresh copy of the target programs
 make clean
 make
@@ -54,6 +83,19 @@ if [ -x contest ] ; then
     testProgram 16
     testProgram 17
     testProgram 18
+    testProgram 19
+    testProgram 20
+
+    # Test 22 loads the snapshot test 21 saves, and adds to its log
+    rm -f snap-21.bin snap-21.bin.log
+    testProgram 21
+    testProgram 22
+    rm -f snap-21.bin snap-21.bin.log
+    testProgram 23
+
+    testReplay 06
+    testReplay 13
+    testReplay 20
 else
     echo "**** Your program didn't compile successfully, so we couldn't test it."
     FAIL=1
@@ -4,9 +4,47 @@
 
     This component will define functions for testing individual bits and setting and clearing
     individual bits in a byte. It's used by the conceal and extract programs.
+
+    It also has the packing kernels that hide and recover whole groups of message bits. Every
+    GROUP_SIZE color bytes hold exactly numBits message bytes, so a group's message bits fit in
+    one 64-bit word. There's a specialized kernel for each bit count, generated by a macro so the
+    shifts and masks are compile-time constants, plus kernels using the BMI2 PDEP/PEXT
+    instructions, which spread or gather a whole group in one instruction, picked at run time on
+    CPUs that have them. For the common bit counts, 1, 2 and 4, there are also SSE2 and AVX2
+    kernels that work on 16 or 32 color bytes at a time.
+
+    The kernels can be forced with the BITS_KERNEL environment variable (portable, bmi2, sse2 or
+    avx2), so the fast ones can be checked against the portable ones.
+
+    Since each group of color bytes maps to its own message bytes, a large buffer can be split into
+    ranges of whole groups and packed on several threads at once, with no shared state between
+    them.
  */
 
 #include "bits.h"
+#include "crc.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined( __GNUC__ ) && defined( __x86_64__ )
+#include <immintrin.h>
+#define HAVE_X86_KERNELS
+#endif
+
+/** Mask for the low-order n bits of a byte. */
+#define LOW_MASK( n ) ( ( 1u << ( n ) ) - 1 )
+
+/** Mask for the low-order n bits of every byte in a 64-bit word. */
+#define GROUP_MASK( n ) ( 0x0101010101010101ull * LOW_MASK( n ) )
+
+/** Fewest color bytes worth handing to a thread of their own. */
+#define MIN_RANGE ( 1 << 16 )
+
+/** A kernel that hides or recovers the message bits for a number of whole groups. */
+typedef void (*ConcealKernel)( unsigned char *color, size_t groups, unsigned char const *message );
+typedef void (*ExtractKernel)( unsigned char const *color, size_t groups, unsigned char *message );
 
 bool getBit( unsigned char ch, int n )
 {
@@ -21,3 +59,606 @@ unsigned char putBit( unsigned char ch, int n, bool v )
         return ch & ~( 1 << n );
     }
 }
+
+void putLength( unsigned char *header, uint64_t length )
+{
+    for ( int i = 0; i < LENGTH_SIZE; i++ ) {
+        header[ i ] = length >> ( i * BITS_PER_BYTE );
+    }
+}
+
+uint64_t getLength( unsigned char const *header )
+{
+    uint64_t length = 0;
+    for ( int i = 0; i < LENGTH_SIZE; i++ ) {
+        length |= (uint64_t) header[ i ] << ( i * BITS_PER_BYTE );
+    }
+    return length;
+}
+
+/**
+    Stores a 32-bit value, least significant byte first.
+
+    @param p four bytes to store the value in.
+    @param value value to store.
+ */
+static void putLe32( unsigned char *p, uint32_t value )
+{
+    for ( int i = 0; i < 4; i++ ) {
+        p[ i ] = value >> ( i * BITS_PER_BYTE );
+    }
+}
+
+/**
+    Returns a 32-bit value stored least significant byte first.
+
+    @param p four bytes holding the value.
+    @return the value.
+ */
+static uint32_t getLe32( unsigned char const *p )
+{
+    uint32_t value = 0;
+    for ( int i = 0; i < 4; i++ ) {
+        value |= (uint32_t) p[ i ] << ( i * BITS_PER_BYTE );
+    }
+    return value;
+}
+
+void putCheck( unsigned char *header, uint64_t length, uint32_t crc )
+{
+    putLength( header, length );
+    putLe32( header + LENGTH_SIZE, crc );
+    putLe32( header + CHECK_SIZE - 4, crc32c( 0, header, CHECK_SIZE - 4 ) );
+}
+
+bool getCheck( unsigned char const *header, uint32_t *crc )
+{
+    *crc = getLe32( header + LENGTH_SIZE );
+    return getLe32( header + CHECK_SIZE - 4 ) == crc32c( 0, header, CHECK_SIZE - 4 );
+}
+
+/**
+    Defines the portable kernels for hiding and recovering n bits per color byte. The message
+    bytes for a group are assembled into a little-endian word, then the low n bits of color byte
+    k trade places with bits k * n .. k * n + n - 1 of that word.
+
+    @param n number of bits per color byte.
+ */
+#define DEFINE_KERNELS( n )                                                                      \
+static void concealGroups##n( unsigned char *color, size_t groups,                               \
+                              unsigned char const *message )                                     \
+{                                                                                                \
+    for ( size_t g = 0; g < groups; g++, color += GROUP_SIZE, message += n ) {                  \
+        uint64_t word = 0;                                                                       \
+        for ( int i = 0; i < n; i++ )                                                            \
+            word |= (uint64_t) message[ i ] << ( i * BITS_PER_BYTE );                           \
+        for ( int k = 0; k < GROUP_SIZE; k++ )                                                   \
+            color[ k ] = ( color[ k ] & ~LOW_MASK( n ) ) | ( ( word >> ( k * n ) ) & LOW_MASK( n ) ); \
+    }                                                                                            \
+}                                                                                                \
+                                                                                                 \
+static void extractGroups##n( unsigned char const *color, size_t groups,                         \
+                              unsigned char *message )                                           \
+{                                                                                                \
+    for ( size_t g = 0; g < groups; g++, color += GROUP_SIZE, message += n ) {                  \
+        uint64_t word = 0;                                                                       \
+        for ( int k = 0; k < GROUP_SIZE; k++ )                                                   \
+            word |= (uint64_t) ( color[ k ] & LOW_MASK( n ) ) << ( k * n );                     \
+        for ( int i = 0; i < n; i++ )                                                            \
+            message[ i ] = word >> ( i * BITS_PER_BYTE );                                        \
+    }                                                                                            \
+}
+
+DEFINE_KERNELS( 1 )
+DEFINE_KERNELS( 2 )
+DEFINE_KERNELS( 3 )
+DEFINE_KERNELS( 4 )
+DEFINE_KERNELS( 5 )
+DEFINE_KERNELS( 6 )
+DEFINE_KERNELS( 7 )
+
+/**
+    With all 8 bits used, each color byte just becomes a message byte.
+
+    @param color color bytes to hide the message in.
+    @param groups number of groups to fill.
+    @param message message bytes to hide.
+ */
+static void concealGroupsCopy( unsigned char *color, size_t groups, unsigned char const *message )
+{
+    memcpy( color, message, groups * GROUP_SIZE );
+}
+
+/**
+    With all 8 bits used, each message byte is just a color byte.
+
+    @param color color bytes holding the message.
+    @param groups number of groups to recover.
+    @param message buffer to store the message bytes in.
+ */
+static void extractGroupsCopy( unsigned char const *color, size_t groups, unsigned char *message )
+{
+    memcpy( message, color, groups * GROUP_SIZE );
+}
+
+/** Portable kernels, indexed by number of bits. */
+static ConcealKernel concealKernels[ BITS_PER_BYTE + 1 ] = {
+    NULL, concealGroups1, concealGroups2, concealGroups3, concealGroups4,
+    concealGroups5, concealGroups6, concealGroups7, concealGroupsCopy
+};
+static ExtractKernel extractKernels[ BITS_PER_BYTE + 1 ] = {
+    NULL, extractGroups1, extractGroups2, extractGroups3, extractGroups4,
+    extractGroups5, extractGroups6, extractGroups7, extractGroupsCopy
+};
+
+#ifdef HAVE_X86_KERNELS
+
+/**
+    Defines the kernels for n bits per color byte that use PDEP to deposit a group's message word
+    straight into the low bits of its eight color bytes, and PEXT to gather them back.
+
+    @param n number of bits per color byte.
+ */
+#define DEFINE_BMI2_KERNELS( n )                                                                 \
+__attribute__(( target( "bmi2" ) ))                                                              \
+static void concealGroupsBmi2##n( unsigned char *color, size_t groups,                           \
+                                  unsigned char const *message )                                 \
+{                                                                                                \
+    for ( size_t g = 0; g < groups; g++, color += GROUP_SIZE, message += n ) {                  \
+        uint64_t word = 0, pixels;                                                               \
+        if ( ( groups - g ) * n >= sizeof( word ) ) {                                            \
+            memcpy( &word, message, sizeof( word ) );                                            \
+        } else {                                                                                 \
+            memcpy( &word, message, n );                                                         \
+        }                                                                                        \
+        memcpy( &pixels, color, GROUP_SIZE );                                                    \
+        pixels = ( pixels & ~GROUP_MASK( n ) ) | _pdep_u64( word, GROUP_MASK( n ) );            \
+        memcpy( color, &pixels, GROUP_SIZE );                                                    \
+    }                                                                                            \
+}                                                                                                \
+                                                                                                 \
+__attribute__(( target( "bmi2" ) ))                                                              \
+static void extractGroupsBmi2##n( unsigned char const *color, size_t groups,                     \
+                                  unsigned char *message )                                       \
+{                                                                                                \
+    for ( size_t g = 0; g < groups; g++, color += GROUP_SIZE, message += n ) {                  \
+        uint64_t pixels;                                                                         \
+        memcpy( &pixels, color, GROUP_SIZE );                                                    \
+        uint64_t word = _pext_u64( pixels, GROUP_MASK( n ) );                                    \
+        if ( ( groups - g ) * n >= sizeof( word ) ) {                                            \
+            memcpy( message, &word, sizeof( word ) );                                            \
+        } else {                                                                                 \
+            memcpy( message, &word, n );                                                         \
+        }                                                                                        \
+    }                                                                                            \
+}
+
+DEFINE_BMI2_KERNELS( 1 )
+DEFINE_BMI2_KERNELS( 2 )
+DEFINE_BMI2_KERNELS( 3 )
+DEFINE_BMI2_KERNELS( 4 )
+DEFINE_BMI2_KERNELS( 5 )
+DEFINE_BMI2_KERNELS( 6 )
+DEFINE_BMI2_KERNELS( 7 )
+
+/** BMI2 kernels, indexed by number of bits.  With 8 bits there's nothing to spread, so the
+    copying kernel is used. */
+static ConcealKernel const concealBmi2Kernels[ BITS_PER_BYTE + 1 ] = {
+    NULL, concealGroupsBmi21, concealGroupsBmi22, concealGroupsBmi23, concealGroupsBmi24,
+    concealGroupsBmi25, concealGroupsBmi26, concealGroupsBmi27, concealGroupsCopy
+};
+static ExtractKernel const extractBmi2Kernels[ BITS_PER_BYTE + 1 ] = {
+    NULL, extractGroupsBmi21, extractGroupsBmi22, extractGroupsBmi23, extractGroupsBmi24,
+    extractGroupsBmi25, extractGroupsBmi26, extractGroupsBmi27, extractGroupsCopy
+};
+
+/**
+    Spreads the bits in each byte of x into two bytes, the low-order bits bits into the first and
+    the next bits bits into the second, doubling the number of bytes in use.
+
+    @param x bytes to spread, in the low half of the register.
+    @param bits number of bits that go in each output byte.
+    @return the spread bytes.
+ */
+static inline __m128i spreadSse2( __m128i x, int bits )
+{
+    __m128i mask = _mm_set1_epi8( LOW_MASK( bits ) );
+    __m128i lo = _mm_and_si128( x, mask );
+    __m128i hi = _mm_and_si128( _mm_srli_epi16( x, bits ), mask );
+    return _mm_unpacklo_epi8( lo, hi );
+}
+
+/**
+    The reverse of spreadSse2(), combining each pair of bytes of x into one byte, with the low
+    bits bits of the first byte in the low-order bits, halving the number of bytes in use.
+
+    @param x bytes to combine.
+    @param bits number of bits to take from each input byte.
+    @return the combined bytes, in the low half of the register.
+ */
+static inline __m128i gatherSse2( __m128i x, int bits )
+{
+    x = _mm_and_si128( x, _mm_set1_epi8( LOW_MASK( bits ) ) );
+    x = _mm_and_si128( _mm_or_si128( x, _mm_srli_epi16( x, BITS_PER_BYTE - bits ) ),
+                       _mm_set1_epi16( 0x00FF ) );
+    return _mm_packus_epi16( x, x );
+}
+
+/**
+    Defines the SSE2 kernels for n bits per color byte, which handle two groups, 16 color bytes,
+    per iteration. The message bytes are spread out in halves until each color byte gets n bits.
+
+    @param n number of bits per color byte, 1, 2 or 4.
+ */
+#define DEFINE_SSE2_KERNELS( n )                                                                 \
+static void concealGroupsSse2##n( unsigned char *color, size_t groups,                           \
+                                  unsigned char const *message )                                 \
+{                                                                                                \
+    __m128i keep = _mm_set1_epi8( (char) ~LOW_MASK( n ) );                                       \
+    size_t g = 0;                                                                                \
+    for ( ; g + 2 <= groups; g += 2, color += 2 * GROUP_SIZE, message += 2 * n ) {              \
+        uint64_t word = 0;                                                                       \
+        memcpy( &word, message, 2 * n );                                                         \
+        __m128i bits = _mm_cvtsi64_si128( word );                                                \
+        for ( int b = BITS_PER_BYTE / 2; b >= n; b /= 2 )                                        \
+            bits = spreadSse2( bits, b );                                                        \
+        __m128i pixels = _mm_loadu_si128( (__m128i *) color );                                   \
+        pixels = _mm_or_si128( _mm_and_si128( pixels, keep ), bits );                            \
+        _mm_storeu_si128( (__m128i *) color, pixels );                                           \
+    }                                                                                            \
+    concealGroups##n( color, groups - g, message );                                              \
+}                                                                                                \
+                                                                                                 \
+static void extractGroupsSse2##n( unsigned char const *color, size_t groups,                     \
+                                  unsigned char *message )                                       \
+{                                                                                                \
+    size_t g = 0;                                                                                \
+    for ( ; g + 2 <= groups; g += 2, color += 2 * GROUP_SIZE, message += 2 * n ) {              \
+        __m128i pixels = _mm_loadu_si128( (__m128i *) color );                                   \
+        uint64_t word;                                                                           \
+        if ( n == 1 ) {                                                                          \
+            word = _mm_movemask_epi8( _mm_slli_epi16( pixels, BITS_PER_BYTE - 1 ) );            \
+        } else {                                                                                 \
+            for ( int b = n; b < BITS_PER_BYTE; b *= 2 )                                         \
+                pixels = gatherSse2( pixels, b );                                                \
+            word = _mm_cvtsi128_si64( pixels );                                                  \
+        }                                                                                        \
+        memcpy( message, &word, 2 * n );                                                         \
+    }                                                                                            \
+    extractGroups##n( color, groups - g, message );                                              \
+}
+
+DEFINE_SSE2_KERNELS( 1 )
+DEFINE_SSE2_KERNELS( 2 )
+DEFINE_SSE2_KERNELS( 4 )
+
+/** Selects bit k % 8 of the message byte spread over color byte k, for one bit per byte. */
+#define AVX2_BIT_SELECT 0x8040201008040201ll
+
+/**
+    AVX2 kernel for hiding one bit per color byte, four groups at a time. Each message byte is
+    copied to the eight color bytes it covers, and each of those keeps just its own bit.
+
+    @param color color bytes to hide the message in.
+    @param groups number of groups to fill.
+    @param message message bytes to hide.
+ */
+__attribute__(( target( "avx2" ) ))
+static void concealGroupsAvx21( unsigned char *color, size_t groups, unsigned char const *message )
+{
+    __m256i keep = _mm256_set1_epi8( (char) ~LOW_MASK( 1 ) );
+    __m256i one = _mm256_set1_epi8( 1 );
+    __m256i select = _mm256_set1_epi64x( AVX2_BIT_SELECT );
+    __m256i copies = _mm256_setr_epi8( 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+                                       2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3 );
+    size_t g = 0;
+    for ( ; g + 4 <= groups; g += 4, color += 4 * GROUP_SIZE, message += 4 ) {
+        int word;
+        memcpy( &word, message, sizeof( word ) );
+        __m256i bits = _mm256_shuffle_epi8( _mm256_set1_epi32( word ), copies );
+        bits = _mm256_and_si256( _mm256_cmpeq_epi8( _mm256_and_si256( bits, select ), select ),
+                                 one );
+        __m256i pixels = _mm256_loadu_si256( (__m256i *) color );
+        pixels = _mm256_or_si256( _mm256_and_si256( pixels, keep ), bits );
+        _mm256_storeu_si256( (__m256i *) color, pixels );
+    }
+    concealGroups1( color, groups - g, message );
+}
+
+/**
+    AVX2 kernel for hiding two bits per color byte, four groups at a time. Each message byte is
+    widened to 32 bits, and its four pairs of bits are spread out to one per byte.
+
+    @param color color bytes to hide the message in.
+    @param groups number of groups to fill.
+    @param message message bytes to hide.
+ */
+__attribute__(( target( "avx2" ) ))
+static void concealGroupsAvx22( unsigned char *color, size_t groups, unsigned char const *message )
+{
+    __m256i keep = _mm256_set1_epi8( (char) ~LOW_MASK( 2 ) );
+    size_t g = 0;
+    for ( ; g + 4 <= groups; g += 4, color += 4 * GROUP_SIZE, message += 8 ) {
+        __m256i bits = _mm256_cvtepu8_epi32( _mm_loadl_epi64( (__m128i *) message ) );
+        bits = _mm256_and_si256( _mm256_or_si256( bits, _mm256_slli_epi32( bits, 12 ) ),
+                                 _mm256_set1_epi32( 0x000F000F ) );
+        bits = _mm256_and_si256( _mm256_or_si256( bits, _mm256_slli_epi32( bits, 6 ) ),
+                                 _mm256_set1_epi32( 0x03030303 ) );
+        __m256i pixels = _mm256_loadu_si256( (__m256i *) color );
+        pixels = _mm256_or_si256( _mm256_and_si256( pixels, keep ), bits );
+        _mm256_storeu_si256( (__m256i *) color, pixels );
+    }
+    concealGroups2( color, groups - g, message );
+}
+
+/**
+    AVX2 kernel for hiding four bits per color byte, four groups at a time. Each message byte is
+    widened to 16 bits, with its high nibble moved up to the second byte.
+
+    @param color color bytes to hide the message in.
+    @param groups number of groups to fill.
+    @param message message bytes to hide.
+ */
+__attribute__(( target( "avx2" ) ))
+static void concealGroupsAvx24( unsigned char *color, size_t groups, unsigned char const *message )
+{
+    __m256i keep = _mm256_set1_epi8( (char) ~LOW_MASK( 4 ) );
+    size_t g = 0;
+    for ( ; g + 4 <= groups; g += 4, color += 4 * GROUP_SIZE, message += 16 ) {
+        __m256i bits = _mm256_cvtepu8_epi16( _mm_loadu_si128( (__m128i *) message ) );
+        bits = _mm256_and_si256( _mm256_or_si256( bits, _mm256_slli_epi16( bits, 4 ) ),
+                                 _mm256_set1_epi16( 0x0F0F ) );
+        __m256i pixels = _mm256_loadu_si256( (__m256i *) color );
+        pixels = _mm256_or_si256( _mm256_and_si256( pixels, keep ), bits );
+        _mm256_storeu_si256( (__m256i *) color, pixels );
+    }
+    concealGroups4( color, groups - g, message );
+}
+
+/**
+    AVX2 kernel for recovering one bit per color byte, four groups at a time, by moving each
+    byte's low bit up to where movemask collects it.
+
+    @param color color bytes holding the message.
+    @param groups number of groups to recover.
+    @param message buffer to store the message bytes in.
+ */
+__attribute__(( target( "avx2" ) ))
+static void extractGroupsAvx21( unsigned char const *color, size_t groups, unsigned char *message )
+{
+    size_t g = 0;
+    for ( ; g + 4 <= groups; g += 4, color += 4 * GROUP_SIZE, message += 4 ) {
+        __m256i pixels = _mm256_loadu_si256( (__m256i *) color );
+        int word = _mm256_movemask_epi8( _mm256_slli_epi16( pixels, BITS_PER_BYTE - 1 ) );
+        memcpy( message, &word, sizeof( word ) );
+    }
+    extractGroups1( color, groups - g, message );
+}
+
+/**
+    AVX2 kernel for recovering two bits per color byte, four groups at a time. Pairs of color
+    bytes are combined with a multiply-add, then pairs of those, then packed down to bytes.
+
+    @param color color bytes holding the message.
+    @param groups number of groups to recover.
+    @param message buffer to store the message bytes in.
+ */
+__attribute__(( target( "avx2" ) ))
+static void extractGroupsAvx22( unsigned char const *color, size_t groups, unsigned char *message )
+{
+    __m256i lanes = _mm256_setr_epi32( 0, 4, 0, 0, 0, 0, 0, 0 );
+    size_t g = 0;
+    for ( ; g + 4 <= groups; g += 4, color += 4 * GROUP_SIZE, message += 8 ) {
+        __m256i pixels = _mm256_loadu_si256( (__m256i *) color );
+        pixels = _mm256_and_si256( pixels, _mm256_set1_epi8( LOW_MASK( 2 ) ) );
+        pixels = _mm256_maddubs_epi16( pixels, _mm256_set1_epi16( 0x0401 ) );
+        pixels = _mm256_madd_epi16( pixels, _mm256_set1_epi32( 0x00100001 ) );
+        pixels = _mm256_packus_epi32( pixels, pixels );
+        pixels = _mm256_packus_epi16( pixels, pixels );
+        pixels = _mm256_permutevar8x32_epi32( pixels, lanes );
+        _mm_storel_epi64( (__m128i *) message, _mm256_castsi256_si128( pixels ) );
+    }
+    extractGroups2( color, groups - g, message );
+}
+
+/**
+    AVX2 kernel for recovering four bits per color byte, four groups at a time. Pairs of color
+    bytes are combined with a multiply-add, then packed down to bytes.
+
+    @param color color bytes holding the message.
+    @param groups number of groups to recover.
+    @param message buffer to store the message bytes in.
+ */
+__attribute__(( target( "avx2" ) ))
+static void extractGroupsAvx24( unsigned char const *color, size_t groups, unsigned char *message )
+{
+    size_t g = 0;
+    for ( ; g + 4 <= groups; g += 4, color += 4 * GROUP_SIZE, message += 16 ) {
+        __m256i pixels = _mm256_loadu_si256( (__m256i *) color );
+        pixels = _mm256_and_si256( pixels, _mm256_set1_epi8( LOW_MASK( 4 ) ) );
+        pixels = _mm256_maddubs_epi16( pixels, _mm256_set1_epi16( 0x1001 ) );
+        pixels = _mm256_packus_epi16( pixels, pixels );
+        pixels = _mm256_permute4x64_epi64( pixels, 0x08 );
+        _mm_storeu_si128( (__m128i *) message, _mm256_castsi256_si128( pixels ) );
+    }
+    extractGroups4( color, groups - g, message );
+}
+
+#endif
+
+/**
+    Replaces the portable kernels with the fastest ones this CPU supports, or with the ones named
+    by the BITS_KERNEL environment variable, if it's set.
+ */
+static void pickKernels( void )
+{
+#ifdef HAVE_X86_KERNELS
+    char const *name = getenv( "BITS_KERNEL" );
+    __builtin_cpu_init();
+    bool bmi2 = __builtin_cpu_supports( "bmi2" ) && ( !name || strcmp( name, "portable" ) != 0 );
+    bool sse2 = !name || strcmp( name, "sse2" ) == 0 || strcmp( name, "avx2" ) == 0;
+    bool avx2 = __builtin_cpu_supports( "avx2" ) && ( !name || strcmp( name, "avx2" ) == 0 );
+
+    if ( bmi2 ) {
+        memcpy( concealKernels, concealBmi2Kernels, sizeof( concealKernels ) );
+        memcpy( extractKernels, extractBmi2Kernels, sizeof( extractKernels ) );
+    }
+    if ( avx2 ) {
+        concealKernels[ 1 ] = concealGroupsAvx21;
+        concealKernels[ 2 ] = concealGroupsAvx22;
+        concealKernels[ 4 ] = concealGroupsAvx24;
+        extractKernels[ 1 ] = extractGroupsAvx21;
+        extractKernels[ 2 ] = extractGroupsAvx22;
+        extractKernels[ 4 ] = extractGroupsAvx24;
+    } else if ( sse2 ) {
+        concealKernels[ 1 ] = concealGroupsSse21;
+        concealKernels[ 2 ] = concealGroupsSse22;
+        concealKernels[ 4 ] = concealGroupsSse24;
+        extractKernels[ 1 ] = extractGroupsSse21;
+        extractKernels[ 2 ] = extractGroupsSse22;
+        extractKernels[ 4 ] = extractGroupsSse24;
+    }
+#endif
+}
+
+void chooseKernels( void )
+{
+    // Batch jobs can get here on several threads at once, so the tables are filled in exactly
+    // once, and every caller waits until they're ready.
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+    pthread_once( &once, pickKernels );
+}
+
+void concealBits( unsigned char *color, size_t count, unsigned char const *message,
+                  int numBits )
+{
+    chooseKernels();
+    size_t groups = count / GROUP_SIZE;
+    concealKernels[ numBits ]( color, groups, message );
+
+    // Finish any partial group at the end a bit at a time.
+    message += groups * numBits;
+    int bPos = 0;
+    for ( size_t i = groups * GROUP_SIZE; i < count; i++ ) {
+        for ( int j = 0; j < numBits; j++ ) {
+            color[ i ] = putBit( color[ i ], j, getBit( *message, bPos++ ) );
+            if ( bPos == BITS_PER_BYTE ) {
+                bPos = 0;
+                message++;
+            }
+        }
+    }
+}
+
+void extractBits( unsigned char const *color, size_t count, unsigned char *message,
+                  int numBits )
+{
+    chooseKernels();
+    size_t groups = count / GROUP_SIZE;
+    extractKernels[ numBits ]( color, groups, message );
+
+    // Finish any partial group at the end a bit at a time.
+    size_t tail = count - groups * GROUP_SIZE;
+    message += groups * numBits;
+    memset( message, 0, ( tail * numBits + BITS_PER_BYTE - 1 ) / BITS_PER_BYTE );
+    int bPos = 0;
+    for ( size_t i = groups * GROUP_SIZE; i < count; i++ ) {
+        for ( int j = 0; j < numBits; j++ ) {
+            *message = putBit( *message, bPos++, getBit( color[ i ], j ) );
+            if ( bPos == BITS_PER_BYTE ) {
+                bPos = 0;
+                message++;
+            }
+        }
+    }
+}
+
+/** A buffer being packed or unpacked in parallel, split into ranges of whole groups. */
+typedef struct {
+    unsigned char *color;
+    unsigned char *message;
+    size_t count;
+    size_t range;
+    int numBits;
+} RangeJob;
+
+/**
+    Pool task hiding the message bits for one range of a RangeJob.
+
+    @param arg the RangeJob.
+    @param index number of the range.
+    @param thread worker thread running the task (unused).
+ */
+static void concealRange( void *arg, size_t index, int thread )
+{
+    RangeJob *job = (RangeJob *) arg;
+    size_t start = index * job->range;
+    size_t count = job->count - start < job->range ? job->count - start : job->range;
+    concealBits( job->color + start, count, job->message + start / GROUP_SIZE * job->numBits,
+                 job->numBits );
+}
+
+/**
+    Pool task recovering the message bits for one range of a RangeJob.
+
+    @param arg the RangeJob.
+    @param index number of the range.
+    @param thread worker thread running the task (unused).
+ */
+static void extractRange( void *arg, size_t index, int thread )
+{
+    RangeJob *job = (RangeJob *) arg;
+    size_t start = index * job->range;
+    size_t count = job->count - start < job->range ? job->count - start : job->range;
+    extractBits( job->color + start, count, job->message + start / GROUP_SIZE * job->numBits,
+                 job->numBits );
+}
+
+/**
+    Splits count color bytes into one range per thread, each a whole number of groups and none
+    smaller than MIN_RANGE.
+
+    @param pool pool the ranges will run on, or NULL.
+    @param count number of color bytes.
+    @return number of color bytes in each range but the last.
+ */
+static size_t rangeSize( Pool *pool, size_t count )
+{
+    int threads = pool ? poolThreads( pool ) : 1;
+    size_t range = ( count + threads - 1 ) / threads;
+    range = ( range + GROUP_SIZE - 1 ) / GROUP_SIZE * GROUP_SIZE;
+    return range < MIN_RANGE ? MIN_RANGE : range;
+}
+
+int packingThreads( size_t count, int threads )
+{
+    size_t ranges = count / MIN_RANGE;
+    if ( ranges < 2 ) {
+        return 1;
+    }
+    return ranges < (size_t) threads ? (int) ranges : threads;
+}
+
+void concealBitsParallel( Pool *pool, unsigned char *color, size_t count,
+                          unsigned char const *message, int numBits )
+{
+    size_t range = rangeSize( pool, count );
+    if ( range >= count ) {
+        concealBits( color, count, message, numBits );
+        return;
+    }
+    RangeJob job = { color, (unsigned char *) message, count, range, numBits };
+    runPool( pool, concealRange, &job, ( count + range - 1 ) / range );
+}
+
+void extractBitsParallel( Pool *pool, unsigned char const *color, size_t count,
+                          unsigned char *message, int numBits )
+{
+    size_t range = rangeSize( pool, count );
+    if ( range >= count ) {
+        extractBits( color, count, message, numBits );
+        return;
+    }
+    RangeJob job = { (unsigned char *) color, message, count, range, numBits };
+    runPool( pool, extractRange, &job, ( count + range - 1 ) / range );
+}
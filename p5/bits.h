@@ -3,17 +3,36 @@
     @author Selena Chen (schen53)
 
     Header file for the bits.c component, with functions supporting
-    copying a bit from one character to another.
+    copying a bit from one character to another, and for hiding whole
+    blocks of message bits in the low-order bits of color bytes.
 */
 
 #ifndef _BITS_H_
 #define _BITS_H_
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "pool.h"
 
 /** Number of bits per byte. */
 #define BITS_PER_BYTE 8
 
+/** Number of color bytes in a packing group.  Whatever the number of bits
+    used per color byte, a group always holds a whole number of message
+    bytes, exactly as many as the number of bits used. */
+#define GROUP_SIZE 8
+
+/** Number of bytes in the length header that can be hidden before a message, holding the
+    message length as a little-endian 64-bit integer. */
+#define LENGTH_SIZE 8
+
+/** Number of bytes in the checked header that can be hidden before a message instead: the
+    length header, then a CRC32C of the message, then a CRC32C of those first twelve bytes, so
+    a reader can tell a real header from noise before recovering any of the message. The
+    checksums are little-endian. */
+#define CHECK_SIZE 16
+
 
 /**
     Return the value of bit number n from the given byte.
@@ -35,4 +54,119 @@ bool getBit( unsigned char ch, int n );
 */
 unsigned char putBit( unsigned char ch, int n, bool v );
 
+/**
+    Picks the fastest packing kernels this CPU supports.  This happens
+    the first time any packing function is called, but a program that's
+    about to pack on several threads can call it first, so the choice
+    isn't made while the threads are running.
+*/
+void chooseKernels( void );
+
+/**
+    Hides message bits in the low-order numBits bits of each of count
+    color bytes.  Bits are taken from the message starting with the
+    low-order bit of its first byte, and stored starting with the first
+    color byte.  The message must have at least
+    ( count * numBits + 7 ) / 8 bytes.
+
+    @param color color bytes to hide the message in.
+    @param count number of color bytes.
+    @param message message bits to hide.
+    @param numBits number of bits to use in each color byte, 1 .. 8.
+*/
+void concealBits( unsigned char *color, size_t count, unsigned char const *message,
+                  int numBits );
+
+/**
+    Recovers message bits from the low-order numBits bits of each of
+    count color bytes, the reverse of concealBits().  The message must
+    have room for ( count * numBits + 7 ) / 8 bytes; if the last one is
+    only partly filled, its remaining bits are cleared.
+
+    @param color color bytes holding the message.
+    @param count number of color bytes.
+    @param message buffer to store the message bits in.
+    @param numBits number of bits used in each color byte, 1 .. 8.
+*/
+void extractBits( unsigned char const *color, size_t count, unsigned char *message,
+                  int numBits );
+
+/**
+    Returns the number of threads worth using to pack count color bytes:
+    at most the given number, and no more than one for each range big
+    enough to be worth handing to a thread of its own.  A result of 1
+    means a pool wouldn't be used.
+
+    @param count number of color bytes.
+    @param threads largest number of threads to use.
+    @return number of threads to use, at least 1.
+*/
+int packingThreads( size_t count, int threads );
+
+/**
+    Does the same as concealBits(), but splits the color bytes into ranges
+    of whole groups and hides each range on its own thread from the given
+    pool.  Buffers too small to be worth splitting are done on the calling
+    thread.
+
+    @param pool pool of threads to use, or NULL to do it all on the
+                calling thread.
+    @param color color bytes to hide the message in.
+    @param count number of color bytes.
+    @param message message bits to hide.
+    @param numBits number of bits to use in each color byte, 1 .. 8.
+*/
+void concealBitsParallel( Pool *pool, unsigned char *color, size_t count,
+                          unsigned char const *message, int numBits );
+
+/**
+    Does the same as extractBits(), but splits the color bytes into ranges
+    of whole groups and recovers each range on its own thread from the
+    given pool.
+
+    @param pool pool of threads to use, or NULL to do it all on the
+                calling thread.
+    @param color color bytes holding the message.
+    @param count number of color bytes.
+    @param message buffer to store the message bits in.
+    @param numBits number of bits used in each color byte, 1 .. 8.
+*/
+void extractBitsParallel( Pool *pool, unsigned char const *color, size_t count,
+                          unsigned char *message, int numBits );
+
+/**
+    Stores a message length in a length header.
+
+    @param header LENGTH_SIZE bytes to store the length in.
+    @param length message length to store.
+*/
+void putLength( unsigned char *header, uint64_t length );
+
+/**
+    Returns the message length stored in a length header.
+
+    @param header LENGTH_SIZE bytes holding the length.
+    @return the message length.
+*/
+uint64_t getLength( unsigned char const *header );
+
+/**
+    Stores a message length and checksum in a checked header.
+
+    @param header CHECK_SIZE bytes to store the header in.
+    @param length message length to store.
+    @param crc CRC32C of the message.
+*/
+void putCheck( unsigned char *header, uint64_t length, uint32_t crc );
+
+/**
+    Reports whether a checked header is intact, and returns the message checksum stored in it.
+    The length can be read with getLength().
+
+    @param header CHECK_SIZE bytes holding the header.
+    @param crc pointer to where the CRC32C of the message should be stored.
+    @return true if the header's own checksum matches.
+*/
+bool getCheck( unsigned char const *header, uint32_t *crc );
+
 #endif
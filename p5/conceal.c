@@ -5,17 +5,723 @@
     This component will implement the main function of the conceal program. It will be responsible
     for handling the command-line arguments, reading the image and message files, hiding bits of
     the message in the image and writing out the resulting image file.
+
+    The image and message are streamed through a block at a time, so only a fixed amount of
+    memory is needed, however large the image is. When the files allow it, the next block is read
+    and the previous one written in the background, through an I/O queue, while the current one
+    is packed, so conceal can keep the disk busy instead of taking turns with it.
+
+    With the --in-place option, the input image is copied to the output file, which is then
+    memory-mapped, and only the color bytes that carry the message and its null terminator are
+    rewritten. The rest of the output is left exactly as it was in the input image, so hiding a
+    small message in a large image only touches a few pages. If the output is the input image
+    itself, it's changed right where it is, with no copy.
+
+    With the --threads=N option, each block is split into ranges of whole packing groups that are
+    packed on N threads at once; by default, there's one thread for each processor. Small images
+    get fewer threads, down to none at all, and blocks are never bigger than the image needs. The
+    in-place mode only touches a few pages at a time and stays on one thread.
+
+    With the --key=K option, the message bits are scattered over the color bytes by a permutation
+    picked with the key K, instead of going into consecutive color bytes. Color bytes are only
+    moved within their scatter block, so the image can still be streamed.
+
+    With the --length option, the message is preceded by a LENGTH_SIZE-byte header giving its
+    length instead of being followed by a null terminator, so extract --length knows exactly how
+    much of the image to read. That's also the only way to hide a binary message: without a
+    header, a null character would end the message early, so conceal rejects a message containing
+    one.
+
+    The --check option is like --length, but the header is CHECK_SIZE bytes and also holds a
+    CRC32C of the message and one of the header itself. extract --check uses them to reject an
+    image that doesn't carry a checked message as soon as it has read the header, and to catch a
+    message that's been damaged.
  */
 
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "bits.h"
 #include "image.h"
+#include "pool.h"
+#include "scatter.h"
+#include "ioqueue.h"
+#include "crc.h"
 
 #define ARG_NUM 5
 #define IMAGE_ARG 2
 #define OUTPUT_ARG 3
+#define IN_PLACE_OPT "--in-place"
+#define LENGTH_OPT "--length"
+#define CHECK_OPT "--check"
+#define THREADS_OPT "--threads="
+#define KEY_OPT "--key="
+#define TEMP_SUFFIX ".XXXXXX"
+#define COPY_BUFFER 65536
+#define COPY_CHUNK ( 1 << 30 )
+#define IN_PLACE_CHUNK SCATTER_SIZE
+#define PIPE_SLOTS 3
+#define NULL_MESSAGE "Message contains a null character; use --length"
+
+/**
+    Removes a partly written output file, prints the given error message and terminates the
+    program.
+
+    @param outFile name of the output file to remove, or NULL if there's nothing to remove.
+    @param message error message to print.
+ */
+static void fail( char const *outFile, char const *message )
+{
+    if ( outFile ) {
+        remove( outFile );
+    }
+    fprintf( stderr, "%s\n", message );
+    exit( EXIT_FAILURE );
+}
+
+/**
+    Allocates a buffer, or removes the partly written output file and terminates the program if
+    there isn't enough memory.
+
+    @param size number of bytes to allocate.
+    @param outFile name of the output file to remove, or NULL.
+    @return dynamically allocated buffer.
+ */
+static unsigned char *allocate( size_t size, char const *outFile )
+{
+    unsigned char *buffer = (unsigned char *) malloc( size );
+    if ( !buffer ) {
+        fail( outFile, "Out of memory" );
+    }
+    return buffer;
+}
+
+/**
+    Opens the message file. If it can't be opened, if the image can't hold any message, or if the
+    message is a regular file too large for the image, it prints an appropriate error message and
+    terminates the program. Other messages that turn out to be too long are caught as they're read.
+
+    @param filename name of the message file.
+    @param len number of message bytes the image can hold.
+    @return the open message file.
+ */
+static FILE *openMessage( char const *filename, size_t len )
+{
+    FILE *src = fopen( filename, "rb" );
+    if ( !src ) {
+        perror( filename );
+        exit( EXIT_FAILURE );
+    }
+    struct stat st;
+    if ( len == 0 || ( fstat( fileno( src ), &st ) == 0 && S_ISREG( st.st_mode )
+                       && st.st_size > len ) ) {
+        fclose( src );
+        fprintf( stderr, "Invalid number of bits\n" );
+        exit( EXIT_FAILURE );
+    }
+    return src;
+}
+
+/**
+    Reads the next part of the message, filling in null characters after the end of the message.
+
+    @param src message file.
+    @param message buffer to read the message into.
+    @param count number of message bytes to read.
+    @return number of bytes actually read from the message file.
+ */
+static size_t readMessage( FILE *src, unsigned char *message, size_t count )
+{
+    size_t n = fread( message, sizeof( unsigned char ), count, src );
+    memset( message + n, 0, count - n );
+    return n;
+}
+
+/**
+    Copies the contents of one open file to another, using copy_file_range() so the kernel can
+    share or copy the data without it passing through this process. If that isn't supported
+    between the two files, it falls back to an ordinary read/write loop.
+
+    @param in descriptor for the file to copy from.
+    @param out descriptor for the file to copy to.
+    @return true if the whole file was copied.
+ */
+static bool copyFile( int in, int out )
+{
+    loff_t inOff = 0, outOff = 0;
+    ssize_t n;
+    while ( ( n = copy_file_range( in, &inOff, out, &outOff, COPY_CHUNK, 0 ) ) > 0 )
+        ;
+    if ( n == 0 ) {
+        return true;
+    }
+    if ( errno != ENOSYS && errno != EXDEV && errno != EINVAL && errno != EOPNOTSUPP ) {
+        return false;
+    }
+
+    // Start over with a plain copy.
+    inOff = outOff = 0;
+    if ( ftruncate( out, 0 ) < 0 ) {
+        return false;
+    }
+    char buffer[ COPY_BUFFER ];
+    while ( ( n = pread( in, buffer, sizeof( buffer ), inOff ) ) > 0 ) {
+        for ( ssize_t done = 0; done < n; ) {
+            ssize_t w = pwrite( out, buffer + done, n - done, outOff + done );
+            if ( w < 0 ) {
+                return false;
+            }
+            done += w;
+        }
+        inOff += n;
+        outOff += n;
+    }
+    return n == 0;
+}
+
+/**
+    Stores the header at the start of the hidden data, once the message length and checksum are
+    known. The color bytes holding the header are unpacked, the header is put in the first
+    message bytes, and they're packed again, keeping any message bits that share the last of
+    those color bytes. With a key, those color bytes are scattered over the first scatter block,
+    so the whole block is gathered first and put back afterward.
+
+    @param color first color bytes of the output image, in file order.
+    @param count number of color bytes, a whole scatter block, or the whole image if it's smaller.
+    @param header size of the header, LENGTH_SIZE or CHECK_SIZE.
+    @param length length of the message.
+    @param crc CRC32C of the message, for a checked header.
+    @param userNumBits number of low-order bits used in each color byte.
+    @param key key for scattering the message, or NULL.
+ */
+static void storeHeader( unsigned char *color, size_t count, size_t header, uint64_t length,
+                         uint32_t crc, int userNumBits, uint64_t const *key )
+{
+    unsigned char gathered[ SCATTER_SIZE ];
+    unsigned char *bytes = color;
+    if ( key ) {
+        gatherScattered( gathered, color, 0, count, *key );
+        bytes = gathered;
+    }
+    size_t hCount = ( header * BITS_PER_BYTE + userNumBits - 1 ) / userNumBits;
+    unsigned char message[ CHECK_SIZE + 1 ];
+    extractBits( bytes, hCount, message, userNumBits );
+    if ( header == CHECK_SIZE ) {
+        putCheck( message, length, crc );
+    } else {
+        putLength( message, length );
+    }
+    concealBits( bytes, hCount, message, userNumBits );
+    if ( key ) {
+        putScattered( color, gathered, 0, count, *key );
+    }
+}
+
+/**
+    Reads the part of the message that goes in the next count color bytes. If this is the start
+    of the image and there's a header, room is left for it at the start of the buffer; it's
+    filled in by storeHeader() once the whole message has been read.
+
+    @param src message file.
+    @param message buffer to read the message into.
+    @param count number of color bytes the message bytes go in.
+    @param userNumBits number of low-order bits to use in each color byte.
+    @param header number of header bytes to leave room for.
+    @return number of bytes actually read from the message file.
+ */
+static size_t readBlockMessage( FILE *src, unsigned char *message, size_t count, int userNumBits,
+                                size_t header )
+{
+    size_t mCount = ( count * userNumBits + BITS_PER_BYTE - 1 ) / BITS_PER_BYTE;
+    memset( message, 0, header );
+    return readMessage( src, message + header, mCount - header );
+}
+
+/** Settings and buffers for hiding the message in the image a block at a time. */
+typedef struct {
+    /** Message file. */
+    FILE *src;
+
+    /** Name of the output image, removed if anything goes wrong. */
+    char const *outFile;
+
+    /** Number of low-order bits to use in each color byte. */
+    int userNumBits;
+
+    /** Size of the header before the message, LENGTH_SIZE or CHECK_SIZE, or 0 if the message
+        is followed by a null terminator instead. */
+    size_t header;
+
+    /** Key for scattering the message, or NULL. */
+    uint64_t const *key;
+
+    /** Threads to pack each block on, or NULL. */
+    Pool *pool;
+
+    /** Message bytes for the current block, and color bytes gathered into scattered order when
+        there's a key, each big enough for a whole block. */
+    unsigned char *message;
+    unsigned char *gathered;
+
+    /** Number of message bytes read so far, and their CRC32C, for a checked header. */
+    size_t total;
+    uint32_t crc;
+
+    /** Copy of the first color bytes of the output, enough to hold the length header, and how
+        many of them there are. */
+    unsigned char first[ SCATTER_SIZE ];
+    size_t firstCount;
+} Stream;
+
+/**
+    Hides the next part of the message in a block of color bytes, reading the message bytes that
+    go in it. With a key, the block's color bytes are gathered into the scattered order, packed,
+    and put back.
+
+    @param s stream the block belongs to.
+    @param color color bytes of the block.
+    @param start index of the block's first color byte.
+    @param count number of color bytes in the block.
+ */
+static void hideBlock( Stream *s, unsigned char *color, size_t start, size_t count )
+{
+    size_t skip = start == 0 ? s->header : 0;
+    size_t n = readBlockMessage( s->src, s->message, count, s->userNumBits, skip );
+    if ( !s->header && memchr( s->message + skip, '\0', n ) ) {
+        fail( s->outFile, NULL_MESSAGE );
+    }
+    s->total += n;
+    if ( s->header == CHECK_SIZE ) {
+        s->crc = crc32c( s->crc, s->message + skip, n );
+    }
+    if ( s->key ) {
+        gatherScattered( s->gathered, color, start, count, *s->key );
+        concealBitsParallel( s->pool, s->gathered, count, s->message, s->userNumBits );
+        putScattered( color, s->gathered, start, count, *s->key );
+    } else {
+        concealBitsParallel( s->pool, color, count, s->message, s->userNumBits );
+    }
+    if ( start == 0 ) {
+        memcpy( s->first, color, s->firstCount );
+    }
+}
+
+/**
+    Finishes the output once every block has been written. If the message didn't fit, it removes
+    the output and terminates the program. Otherwise, if there's a header, now that the length
+    and checksum are known, it goes back and stores it, writing just the color bytes that
+    changed.
+
+    @param s stream that was written.
+    @param image dimensions of the image.
+    @param len number of message bytes the image can hold.
+    @param fd output image file.
+    @param offset offset of the pixel data in the output image.
+ */
+static void finishStream( Stream *s, Image *image, size_t len, int fd, off_t offset )
+{
+    if ( s->total + s->header > len || getc( s->src ) != EOF ) {
+        fail( s->outFile, "Invalid number of bits" );
+    }
+    if ( s->header ) {
+        unsigned char patched[ SCATTER_SIZE ];
+        memcpy( patched, s->first, s->firstCount );
+        storeHeader( patched, s->firstCount, s->header, s->total, s->crc, s->userNumBits,
+                     s->key );
+        for ( size_t i = 0; i < s->firstCount; i++ ) {
+            if ( patched[ i ] != s->first[ i ]
+                 && pwrite( fd, patched + i, 1, offset + colorOffset( image, i ) ) != 1 ) {
+                perror( s->outFile );
+                remove( s->outFile );
+                exit( EXIT_FAILURE );
+            }
+        }
+    }
+}
+
+/**
+    Hides the message in the image, streaming the pixel data from the input image to the output
+    a block at a time with ordinary buffered reads and writes. This is used when the input or
+    output can't be read or written at arbitrary offsets, like a pipe.
+
+    @param fp input image, positioned at the start of its pixel data.
+    @param image dimensions of the input image.
+    @param s stream to hide the message with.
+    @param blockSize number of color bytes in each block.
+    @param len number of message bytes the image can hold.
+    @param out output image, positioned at the start of its pixel data.
+ */
+static void concealSerial( FILE *fp, Image *image, Stream *s, size_t blockSize, size_t len,
+                           FILE *out )
+{
+    size_t size = imageSize( image );
+    long offset = ftell( out );
+    unsigned char *color = allocate( blockSize, s->outFile );
+    for ( size_t start = 0; start < size; start += blockSize ) {
+        size_t count = size - start < blockSize ? size - start : blockSize;
+        if ( !readColor( fp, image, color, count ) ) {
+            fail( s->outFile, "Invalid image file" );
+        }
+        hideBlock( s, color, start, count );
+        if ( !writeColor( out, image, color, count ) ) {
+            perror( s->outFile );
+            remove( s->outFile );
+            exit( EXIT_FAILURE );
+        }
+    }
+    free( color );
+    if ( fflush( out ) != 0 ) {
+        perror( s->outFile );
+        remove( s->outFile );
+        exit( EXIT_FAILURE );
+    }
+    finishStream( s, image, len, fileno( out ), offset );
+}
+
+/** One of the buffers the pixel data passes through in concealAsync(). */
+typedef struct {
+    /** File bytes of a block of pixel data, and the buffer's capacity. */
+    unsigned char *raw;
+    size_t cap;
+} Slot;
+
+/**
+    Hides the message in the image, overlapping the I/O with the packing. Blocks of pixel data go
+    around a ring of PIPE_SLOTS buffers: while one block is being packed, the next one is being
+    read from the input image and the previous one written to the output, through an I/O queue.
+    Each block is read and written at its own offset, so the files have to allow that.
+
+    @param fp input image, positioned at the start of its pixel data.
+    @param image dimensions of the input image.
+    @param s stream to hide the message with.
+    @param blockSize number of color bytes in each block.
+    @param len number of message bytes the image can hold.
+    @param out output image, positioned at the start of its pixel data.
+ */
+static void concealAsync( FILE *fp, Image *image, Stream *s, size_t blockSize, size_t len,
+                          FILE *out )
+{
+    size_t size = imageSize( image );
+    size_t blocks = ( size + blockSize - 1 ) / blockSize;
+    int in = fileno( fp ), fd = fileno( out );
+    off_t inOffset = ftell( fp ), outOffset = ftell( out );
+    if ( fflush( out ) != 0 ) {
+        perror( s->outFile );
+        remove( s->outFile );
+        exit( EXIT_FAILURE );
+    }
+
+    // Formats where the color bytes are just the pixel data are packed right in the slots.
+    // Otherwise, each block is unpacked into a separate buffer and packed back afterward.
+    Slot slots[ PIPE_SLOTS ] = { { NULL, 0 } };
+    bool direct = colorIsRaw( image );
+    unsigned char *color = direct ? NULL : allocate( blockSize, s->outFile );
+    IoQueue *queue = makeIoQueue();
+
+    size_t writes = 0;
+    for ( size_t b = 0; b <= blocks; b++ ) {
+        // Start reading block b, once the slot it goes in has been written out.
+        if ( b < blocks ) {
+            if ( b >= PIPE_SLOTS ) {
+                if ( !waitWrite( queue ) ) {
+                    perror( s->outFile );
+                    remove( s->outFile );
+                    exit( EXIT_FAILURE );
+                }
+                writes++;
+            }
+            size_t start = b * blockSize;
+            size_t count = size - start < blockSize ? size - start : blockSize;
+            size_t rawLen = rawOffset( image, start + count ) - rawOffset( image, start );
+            Slot *slot = &slots[ b % PIPE_SLOTS ];
+            if ( rawLen > slot->cap ) {
+                free( slot->raw );
+                slot->raw = allocate( rawLen, s->outFile );
+                slot->cap = rawLen;
+            }
+            submitRead( queue, in, slot->raw, rawLen, inOffset + rawOffset( image, start ) );
+        }
+
+        // Pack block b - 1, which has been reading since the last time around, and start
+        // writing it.
+        if ( b > 0 ) {
+            size_t start = ( b - 1 ) * blockSize;
+            size_t count = size - start < blockSize ? size - start : blockSize;
+            size_t rawLen = rawOffset( image, start + count ) - rawOffset( image, start );
+            Slot *slot = &slots[ ( b - 1 ) % PIPE_SLOTS ];
+            if ( !waitRead( queue ) ) {
+                fail( s->outFile, "Invalid image file" );
+            }
+            if ( direct ) {
+                hideBlock( s, slot->raw, start, count );
+            } else {
+                unpackColor( image, slot->raw, color, start, count );
+                hideBlock( s, color, start, count );
+                packColor( image, slot->raw, color, start, count );
+            }
+            submitWrite( queue, fd, slot->raw, rawLen, outOffset + rawOffset( image, start ) );
+        }
+    }
+    for ( ; writes < blocks; writes++ ) {
+        if ( !waitWrite( queue ) ) {
+            perror( s->outFile );
+            remove( s->outFile );
+            exit( EXIT_FAILURE );
+        }
+    }
+    freeIoQueue( queue );
+    for ( int i = 0; i < PIPE_SLOTS; i++ ) {
+        free( slots[ i ].raw );
+    }
+    free( color );
+    finishStream( s, image, len, fd, outOffset );
+}
+
+/**
+    Hides the message in the image, streaming the pixel data from the input image to the output
+    a block at a time. Every color byte of the output gets message bits, with the low-order bits
+    after the end of the message cleared. With more than one thread, the blocks are made larger
+    so each thread gets a full BLOCK_SIZE of its own, but never larger than the image, rounded up
+    to a whole scatter block. If both files allow it, reading, packing
+    and writing are overlapped with concealAsync(). If the output is the input image itself, the
+    new image is written to a temporary file that replaces it once it's complete.
+
+    @param fp input image, positioned at the start of its pixel data.
+    @param image dimensions of the input image.
+    @param src message file.
+    @param outFile name of the output image.
+    @param userNumBits number of low-order bits to use in each color byte.
+    @param header size of the header before the message, or 0 for a null terminator.
+    @param key key for scattering the message, or NULL.
+    @param pool threads to pack each block on, or NULL.
+ */
+static void concealStream( FILE *fp, Image *image, FILE *src, char const *outFile,
+                           int userNumBits, size_t header, uint64_t const *key, Pool *pool )
+{
+    size_t blockSize = (size_t) BLOCK_SIZE * ( pool ? poolThreads( pool ) : 1 );
+    size_t size = imageSize( image );
+    if ( size < blockSize ) {
+        blockSize = ( size / SCATTER_SIZE + 1 ) * SCATTER_SIZE;
+    }
+    size_t len = size * userNumBits / BITS_PER_BYTE;
+
+    // Truncating the output would lose the input image if they're the same file, so then the
+    // output goes in a temporary file next to it instead, renamed over it at the end.
+    struct stat st, outSt;
+    bool inputOk = fstat( fileno( fp ), &st ) == 0;
+    char *target = NULL, *temp = NULL;
+    FILE *out;
+    if ( inputOk && stat( outFile, &outSt ) == 0 && outSt.st_dev == st.st_dev
+         && outSt.st_ino == st.st_ino && ( target = realpath( outFile, NULL ) ) ) {
+        temp = (char *) allocate( strlen( target ) + strlen( TEMP_SUFFIX ) + 1, NULL );
+        strcpy( temp, target );
+        strcat( temp, TEMP_SUFFIX );
+        int fd = mkstemp( temp );
+        out = fd < 0 || fchmod( fd, st.st_mode & ALLPERMS ) != 0 ? NULL : fdopen( fd, "wb" );
+        if ( !out && fd >= 0 ) {
+            close( fd );
+            remove( temp );
+        }
+    } else {
+        out = fopen( outFile, "wb" );
+    }
+    if ( !out ) {
+        perror( temp ? temp : outFile );
+        exit( EXIT_FAILURE );
+    }
+    char const *partial = temp ? temp : outFile;
+
+    // The header is stored after the rest of the image has been written, so the output has to
+    // allow going back to it. Something that can't be seeked, like a pipe, was there already, so
+    // it's left alone.
+    if ( header && lseek( fileno( out ), 0, SEEK_CUR ) < 0 ) {
+        fprintf( stderr, "Output image can't be seeked; %s needs a regular file\n",
+                 header == CHECK_SIZE ? CHECK_OPT : LENGTH_OPT );
+        exit( EXIT_FAILURE );
+    }
+    writeHeader( out, image );
+
+    Stream s = { src, partial, userNumBits, header, key, pool };
+    s.message = allocate( blockSize, partial );
+    s.gathered = key ? allocate( blockSize, partial ) : NULL;
+    s.total = 0;
+    s.crc = 0;
+    s.firstCount = size < sizeof( s.first ) ? size : sizeof( s.first );
+
+    if ( inputOk && S_ISREG( st.st_mode ) && lseek( fileno( out ), 0, SEEK_CUR ) >= 0 ) {
+        concealAsync( fp, image, &s, blockSize, len, out );
+    } else {
+        concealSerial( fp, image, &s, blockSize, len, out );
+    }
+    free( s.message );
+    free( s.gathered );
+    if ( fclose( out ) != 0 || ( temp && rename( temp, target ) != 0 ) ) {
+        perror( outFile );
+        remove( partial );
+        exit( EXIT_FAILURE );
+    }
+    free( target );
+    free( temp );
+}
+
+/**
+    Hides message bits in a range of color bytes of a memory-mapped image. The color bytes are
+    gathered into a local copy and packed, and only the ones whose low-order bits actually change
+    are stored back, so pages that don't change aren't dirtied.
+
+    @param image image being written.
+    @param pixels mapped pixel data of the image.
+    @param start index of the first color byte.
+    @param count number of color bytes, at most IN_PLACE_CHUNK.
+    @param message message bits to hide.
+    @param userNumBits number of low-order bits to use in each color byte.
+    @param key key for scattering the message, or NULL.
+ */
+static void storeChanges( Image *image, unsigned char *pixels, size_t start, size_t count,
+                          unsigned char const *message, int userNumBits, uint64_t const *key )
+{
+    unsigned char chunk[ IN_PLACE_CHUNK ];
+    for ( size_t i = 0; i < count; i++ ) {
+        chunk[ i ] = pixels[ colorOffset( image, start + i ) ];
+    }
+    if ( key ) {
+        unsigned char gathered[ IN_PLACE_CHUNK ];
+        gatherScattered( gathered, chunk, start, count, *key );
+        concealBits( gathered, count, message, userNumBits );
+        putScattered( chunk, gathered, start, count, *key );
+    } else {
+        concealBits( chunk, count, message, userNumBits );
+    }
+    for ( size_t i = 0; i < count; i++ ) {
+        unsigned char *p = pixels + colorOffset( image, start + i );
+        if ( chunk[ i ] != *p ) {
+            *p = chunk[ i ];
+        }
+    }
+}
+
+/**
+    Hides the message in a copy of the input image without reading or writing the whole image.
+    The output file is created as a copy of the input, mapped into memory, and only the color
+    bytes whose low-order bits actually change are stored to. If the output is the input image
+    itself, it's mapped and changed where it is; then a message found too long partway through
+    is left partly hidden, since there's no copy to throw away.
+
+    @param fp input image, positioned at the start of its pixel data.
+    @param image dimensions of the input image.
+    @param src message file.
+    @param outFile name of the output image.
+    @param userNumBits number of low-order bits to use in each color byte.
+    @param header size of the header before the message, or 0 for a null terminator.
+    @param key key for scattering the message, or NULL.
+ */
+static void concealInPlace( FILE *fp, Image *image, FILE *src, char const *outFile,
+                            int userNumBits, size_t header, uint64_t const *key )
+{
+    long offset = ftell( fp );
+    size_t size = imageSize( image );
+    size_t len = size * userNumBits / BITS_PER_BYTE;
+    size_t mapSize = offset + image->rows * image->stride;
+    struct stat st;
+    if ( fstat( fileno( fp ), &st ) != 0 || st.st_size < mapSize ) {
+        fprintf( stderr, "Invalid image file\n" );
+        exit( EXIT_FAILURE );
+    }
+
+    // If the output is the input image itself, it's just mapped and changed where it is.
+    // Otherwise, it's emptied and the input copied into it, and it's removed if anything goes
+    // wrong.
+    int out = open( outFile, O_RDWR | O_CREAT, 0666 );
+    struct stat outSt;
+    if ( out < 0 || fstat( out, &outSt ) != 0 ) {
+        perror( outFile );
+        exit( EXIT_FAILURE );
+    }
+    bool same = outSt.st_dev == st.st_dev && outSt.st_ino == st.st_ino;
+    char const *partial = same ? NULL : outFile;
+    if ( !same && ( ftruncate( out, 0 ) != 0 || !copyFile( fileno( fp ), out ) ) ) {
+        perror( outFile );
+        remove( outFile );
+        exit( EXIT_FAILURE );
+    }
+
+    unsigned char *map = mmap( NULL, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, out, 0 );
+    if ( map == MAP_FAILED ) {
+        perror( outFile );
+        if ( !same ) {
+            remove( outFile );
+        }
+        exit( EXIT_FAILURE );
+    }
+    unsigned char *pixels = map + offset;
+
+    // Only the color bytes holding the message and its terminator or header need to be visited.
+    // They're gathered a chunk at a time into a local copy and packed, and only the bytes that
+    // changed are stored. With a key, the message is spread over whole chunks, the scatter blocks.
+    unsigned char message[ IN_PLACE_CHUNK ];
+    size_t total = 0;
+    uint32_t crc = 0;
+    bool ended = false;
+    for ( size_t start = 0; start < size && !ended; start += IN_PLACE_CHUNK ) {
+        size_t count = size - start < IN_PLACE_CHUNK ? size - start : IN_PLACE_CHUNK;
+        size_t mCount = ( count * userNumBits + BITS_PER_BYTE - 1 ) / BITS_PER_BYTE;
+        size_t skip = start == 0 ? header : 0;
+        size_t n = readBlockMessage( src, message, count, userNumBits, skip );
+        if ( !header && memchr( message + skip, '\0', n ) ) {
+            munmap( map, mapSize );
+            close( out );
+            fail( partial, NULL_MESSAGE );
+        }
+        total += n;
+        if ( header == CHECK_SIZE ) {
+            crc = crc32c( crc, message + skip, n );
+        }
+        if ( skip + n < mCount ) {
+            // The message ends in this chunk, along with its terminator, if it has one.
+            size_t used = skip + n + ( header ? 0 : 1 );
+            size_t need = ( used * BITS_PER_BYTE + userNumBits - 1 ) / userNumBits;
+            if ( !key && need < count ) {
+                count = need;
+            }
+            ended = true;
+        }
+        storeChanges( image, pixels, start, count, message, userNumBits, key );
+    }
+
+    // Now that the length is known, go back and put it in the header.
+    if ( header && total + header <= len ) {
+        size_t count = size < SCATTER_SIZE ? size : SCATTER_SIZE;
+        unsigned char first[ SCATTER_SIZE ];
+        for ( size_t i = 0; i < count; i++ ) {
+            first[ i ] = pixels[ colorOffset( image, i ) ];
+        }
+        storeHeader( first, count, header, total, crc, userNumBits, key );
+        for ( size_t i = 0; i < count; i++ ) {
+            if ( first[ i ] != pixels[ colorOffset( image, i ) ] ) {
+                pixels[ colorOffset( image, i ) ] = first[ i ];
+            }
+        }
+    }
+
+    munmap( map, mapSize );
+    if ( close( out ) != 0 ) {
+        perror( outFile );
+        if ( !same ) {
+            remove( outFile );
+        }
+        exit( EXIT_FAILURE );
+    }
+    if ( total + header > len || ( !ended && getc( src ) != EOF ) ) {
+        fail( partial, "Invalid number of bits" );
+    }
+}
 
 /**
     Program starting point.
@@ -26,8 +732,36 @@
  */
 int main( int argc, char *argv[] )
 {
+    bool inPlace = false;
+    size_t header = 0;
+    int threads = defaultThreads();
+    uint64_t keyValue;
+    uint64_t const *key = NULL;
+    while ( argc > 1 && strncmp( argv[ 1 ], "--", 2 ) == 0 ) {
+        if ( strcmp( argv[ 1 ], IN_PLACE_OPT ) == 0 ) {
+            inPlace = true;
+        } else if ( strcmp( argv[ 1 ], LENGTH_OPT ) == 0 ) {
+            header = header ? header : LENGTH_SIZE;
+        } else if ( strcmp( argv[ 1 ], CHECK_OPT ) == 0 ) {
+            header = CHECK_SIZE;
+        } else if ( strncmp( argv[ 1 ], KEY_OPT, strlen( KEY_OPT ) ) == 0 ) {
+            keyValue = scatterKey( argv[ 1 ] + strlen( KEY_OPT ) );
+            key = &keyValue;
+        } else if ( strncmp( argv[ 1 ], THREADS_OPT, strlen( THREADS_OPT ) ) == 0 ) {
+            threads = atoi( argv[ 1 ] + strlen( THREADS_OPT ) );
+            if ( threads < 1 ) {
+                fprintf( stderr, "Invalid number of threads\n" );
+                exit( EXIT_FAILURE );
+            }
+        } else {
+            break;
+        }
+        argc--;
+        argv++;
+    }
     if ( argc != ARG_NUM ) {
-        fprintf( stderr, "usage: conceal <input-message> <input-image> <output-image> <bits>\n" );
+        fprintf( stderr, "usage: conceal [--in-place] [--length] [--check] [--key=K] "
+                 "[--threads=N] <input-message> <input-image> <output-image> <bits>\n" );
         exit( EXIT_FAILURE );
     }
     int userNumBits = atoi( argv[ argc - 1 ] );
@@ -35,47 +769,30 @@ int main( int argc, char *argv[] )
         fprintf( stderr, "Invalid number of bits\n" );
         exit( EXIT_FAILURE );
     }
-    Image *image = readImage( argv[ IMAGE_ARG ] );
-    FILE *src = fopen( argv[ 1 ], "r" );
-    if ( !src ) {
-        fclose( src );
-        perror( argv[ 1 ] );
-        exit( EXIT_FAILURE );
-    }
-    int len = ( image->rows * image->cols * PIXEL_WIDTH * userNumBits ) / BITS_PER_BYTE;
-    if ( len == 0 ) {
-        fclose( src );
-        fprintf( stderr, "Invalid number of bits\n" );
-        exit( EXIT_FAILURE );
-    }
-    int pos = 0;
-    char message[ len + 1 ];
-    for ( int i = 0; i < len + 1; i++ ) {
-        message[ i ] = '\0';
-    }
-    while ( strlen( message ) <= len && fscanf( src, "%c", &message[ pos ] ) == 1 ) {
-        pos++;
-    }
-    if ( fscanf( src, "%*c" ) != EOF ) {
-        fclose( src );
-        fprintf( stderr, "Invalid number of bits\n" );
+    FILE *fp = fopen( argv[ IMAGE_ARG ], "rb" );
+    if ( !fp ) {
+        perror( argv[ IMAGE_ARG ] );
         exit( EXIT_FAILURE );
     }
-    fclose( src );
-    while ( pos != len + 1 ) {
-        message[ pos++ ] = '\0';
-    }
-    int mPos = 0;
-    int bPos = 0;
-    for ( int i = 0; i < image->rows * image->cols * PIXEL_WIDTH; i++ ) {
-        for ( int j = 0; j < userNumBits; j++ ) {
-            image->color[ i ] = putBit( image->color[ i ], j, getBit( message[ mPos ], bPos++ ) );
-            if ( bPos == BITS_PER_BYTE ) {
-                bPos = 0;
-                mPos++;
-            }
+    Image image;
+    readHeader( fp, &image );
+    size_t len = imageSize( &image ) * userNumBits / BITS_PER_BYTE;
+    len = len < header ? 0 : len - header;
+    FILE *src = openMessage( argv[ 1 ], len );
+
+    if ( inPlace ) {
+        concealInPlace( fp, &image, src, argv[ OUTPUT_ARG ], userNumBits, header, key );
+    } else {
+        threads = packingThreads( imageSize( &image ), threads );
+        Pool *pool = threads > 1 ? makePool( threads ) : NULL;
+        concealStream( fp, &image, src, argv[ OUTPUT_ARG ], userNumBits, header, key,
+                       pool );
+        if ( pool ) {
+            freePool( pool );
         }
     }
-    writeImage( image, argv[ OUTPUT_ARG ] );
-    freeImage( image );
+    clearImage( &image );
+    fclose( src );
+    fclose( fp );
+    return EXIT_SUCCESS;
 }
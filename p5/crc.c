@@ -0,0 +1,134 @@
+/**
+    @file crc.c
+    @author Selena Chen (schen53)
+
+    This component implements CRC32C. On x86-64 processors with SSE4.2, it uses the CRC32
+    instruction, eight bytes at a time. Otherwise, it uses slicing-by-8: eight lookup tables,
+    built on first use, that together advance the checksum over eight bytes at once. The table
+    version can be forced with the CRC_KERNEL environment variable set to table, so the two can be
+    checked against each other.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "crc.h"
+
+#if defined( __GNUC__ ) && defined( __x86_64__ )
+#define HAVE_SSE42_CRC
+#endif
+
+/** CRC32C polynomial, bit-reversed. */
+#define POLY 0x82f63b78u
+
+/** Number of lookup tables, and bytes handled per step, for slicing-by-8. */
+#define SLICES 8
+
+/** Lookup tables: table[ 0 ] advances the checksum over one byte, and table[ k ] over a byte
+    followed by k zero bytes. */
+static uint32_t table[ SLICES ][ 256 ];
+
+/**
+    Fills in the lookup tables.
+ */
+static void makeTables()
+{
+    for ( int b = 0; b < 256; b++ ) {
+        uint32_t crc = b;
+        for ( int i = 0; i < 8; i++ ) {
+            crc = crc & 1 ? ( crc >> 1 ) ^ POLY : crc >> 1;
+        }
+        table[ 0 ][ b ] = crc;
+    }
+    for ( int b = 0; b < 256; b++ ) {
+        for ( int k = 1; k < SLICES; k++ ) {
+            uint32_t prev = table[ k - 1 ][ b ];
+            table[ k ][ b ] = ( prev >> 8 ) ^ table[ 0 ][ prev & 0xff ];
+        }
+    }
+}
+
+/**
+    Advances a checksum, without the initial and final inversion, using the lookup tables.
+
+    @param crc checksum so far.
+    @param p bytes to add.
+    @param len number of bytes.
+    @return new checksum.
+ */
+static uint32_t crcTable( uint32_t crc, unsigned char const *p, size_t len )
+{
+    for ( ; len >= SLICES; p += SLICES, len -= SLICES ) {
+        uint64_t word;
+        memcpy( &word, p, sizeof( word ) );
+        word ^= crc;
+        crc = table[ 7 ][ word & 0xff ] ^ table[ 6 ][ ( word >> 8 ) & 0xff ]
+            ^ table[ 5 ][ ( word >> 16 ) & 0xff ] ^ table[ 4 ][ ( word >> 24 ) & 0xff ]
+            ^ table[ 3 ][ ( word >> 32 ) & 0xff ] ^ table[ 2 ][ ( word >> 40 ) & 0xff ]
+            ^ table[ 1 ][ ( word >> 48 ) & 0xff ] ^ table[ 0 ][ word >> 56 ];
+    }
+    for ( ; len > 0; p++, len-- ) {
+        crc = ( crc >> 8 ) ^ table[ 0 ][ ( crc ^ *p ) & 0xff ];
+    }
+    return crc;
+}
+
+#ifdef HAVE_SSE42_CRC
+
+/**
+    Advances a checksum, without the initial and final inversion, using the SSE4.2 CRC32
+    instruction.
+
+    @param crc checksum so far.
+    @param p bytes to add.
+    @param len number of bytes.
+    @return new checksum.
+ */
+__attribute__(( target( "sse4.2" ) ))
+static uint32_t crcSse42( uint32_t crc, unsigned char const *p, size_t len )
+{
+    uint64_t c = crc;
+    for ( ; len >= sizeof( uint64_t ); p += sizeof( uint64_t ), len -= sizeof( uint64_t ) ) {
+        uint64_t word;
+        memcpy( &word, p, sizeof( word ) );
+        c = __builtin_ia32_crc32di( c, word );
+    }
+    crc = c;
+    for ( ; len > 0; p++, len-- ) {
+        crc = __builtin_ia32_crc32qi( crc, *p );
+    }
+    return crc;
+}
+
+#endif
+
+/** Function that advances a checksum, picked by pickKernel(). */
+static uint32_t (*kernel)( uint32_t, unsigned char const *, size_t ) = crcTable;
+
+/**
+    Picks the fastest way to compute checksums on this CPU, unless the CRC_KERNEL environment
+    variable asks for the tables, and builds the tables if they're going to be used.
+ */
+static void pickKernel( void )
+{
+#ifdef HAVE_SSE42_CRC
+    char const *name = getenv( "CRC_KERNEL" );
+    __builtin_cpu_init();
+    if ( __builtin_cpu_supports( "sse4.2" ) && ( !name || strcmp( name, "table" ) != 0 ) ) {
+        kernel = crcSse42;
+    }
+#endif
+    if ( kernel == crcTable ) {
+        makeTables();
+    }
+}
+
+uint32_t crc32c( uint32_t crc, void const *data, size_t len )
+{
+    // Batch jobs can get here on several threads at once, so the choice is made and the tables
+    // are built exactly once, and every caller waits until they're ready.
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+    pthread_once( &once, pickKernel );
+    return ~kernel( ~crc, (unsigned char const *) data, len );
+}
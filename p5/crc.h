@@ -0,0 +1,27 @@
+/**
+    @file crc.h
+    @author Selena Chen (schen53)
+
+    Header for the crc component, which computes CRC32C (Castagnoli) checksums, used to check
+    that a hidden message came through intact.
+ */
+
+#ifndef _CRC_H_
+#define _CRC_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+    This function extends a CRC32C checksum with more data. Starting from 0 and passing each
+    result back in gives the checksum of everything passed so far, the same as if it had all been
+    passed in one call.
+
+    @param crc checksum of the data so far, or 0 to start.
+    @param data bytes to add.
+    @param len number of bytes to add.
+    @return checksum including the new bytes.
+ */
+uint32_t crc32c( uint32_t crc, void const *data, size_t len );
+
+#endif
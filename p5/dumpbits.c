@@ -1,27 +1,228 @@
-/** Helpful program to report the value in every byte of stdin, in binary. */
+/** Helpful program to report the value in every byte of stdin, in binary.
+
+    usage: dumpbits [--offset=N] [--length=N] [file [other-file]]
+
+    With no file, standard input is dumped.  The --offset and --length
+    options limit the dump to a window of the input, and can be given in
+    decimal or, like the byte indexes in the output, in hex with a 0x
+    prefix.  Given two files, only the bytes where they differ are
+    printed, with the bits from each file side by side, and dashes for
+    bytes past the end of the shorter one.
+
+    Input is read and output written in large blocks, and each byte is
+    formatted by copying its eight characters from a table, since this is
+    used to look at the payloads of multi-megabyte images. */
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
-void printBits( unsigned char ch )
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#define OFFSET_OPT "--offset="
+#define LENGTH_OPT "--length="
+
+/** Number of bytes read from the input at a time. */
+#define IN_SIZE ( 1 << 16 )
+
+/** Size of the output buffer. */
+#define OUT_SIZE ( 1 << 20 )
+
+/** Longest line the program prints: a 16-digit index, two bytes of bits
+    and the spaces and newline between them. */
+#define MAX_LINE 40
+
+/** Binary representation of every byte value, high-order bit first. */
+static char bitTable[ 256 ][ 8 ];
+
+/** Buffered output, and how much of it is used. */
+static char out[ OUT_SIZE ];
+static size_t outLen = 0;
+
+/** Fill in bitTable. */
+void makeTable()
 {
-  // Start printing bits from the high-order one.
-  for ( int i = 7; i >= 0; i-- )
-    printf( "%c", ch & ( 0x01 << i ) ? '1' : '0' );
+  for ( int ch = 0; ch < 256; ch++ )
+    for ( int i = 7; i >= 0; i-- )
+      bitTable[ ch ][ 7 - i ] = ch & ( 0x01 << i ) ? '1' : '0';
 }
 
-int main()
+/** Write out everything in the output buffer. */
+void flushOut()
 {
-  // Normally, standard input will be in text mode, so it may not handle
-  // binary input well. This should fix that.
-  freopen( NULL, "rb", stdin );
+  if ( fwrite( out, 1, outLen, stdout ) != outLen ) {
+    perror( "dumpbits" );
+    exit( EXIT_FAILURE );
+  }
+  outLen = 0;
+}
+
+/** Start a line of output with the given byte index, in hex, at least
+    four digits wide, followed by a space. */
+void putIndex( unsigned long long idx )
+{
+  if ( outLen + MAX_LINE > OUT_SIZE )
+    flushOut();
+  char digits[ 16 ];
+  int n = 0;
+  do {
+    digits[ n++ ] = "0123456789abcdef"[ idx & 0xf ];
+    idx >>= 4;
+  } while ( idx || n < 4 );
+  while ( n > 0 )
+    out[ outLen++ ] = digits[ --n ];
+  out[ outLen++ ] = ' ';
+}
+
+/** Add the binary representation of a byte to the output, or dashes if
+    it's EOF. */
+void putBits( int ch )
+{
+  memcpy( out + outLen, ch == EOF ? "--------" : bitTable[ ch ], 8 );
+  outLen += 8;
+}
+
+/** Open a file for reading, or exit with an error message. */
+FILE *openInput( char const *name )
+{
+  FILE *fp = fopen( name, "rb" );
+  if ( !fp ) {
+    perror( name );
+    exit( EXIT_FAILURE );
+  }
+  return fp;
+}
 
-  int idx = 0;
-  int ch;
+/** Skip past the first offset bytes of a file, seeking if possible. */
+void skipTo( FILE *fp, unsigned long long offset )
+{
+  if ( offset == 0 || fseeko( fp, offset, SEEK_SET ) == 0 )
+    return;
+  char buffer[ IN_SIZE ];
+  while ( offset > 0 ) {
+    size_t n = offset < IN_SIZE ? offset : IN_SIZE;
+    n = fread( buffer, 1, n, fp );
+    if ( n == 0 )
+      return;
+    offset -= n;
+  }
+}
+
+/** Read the next block of the window, updating how much of it is left.
+    Returns the number of bytes read, 0 at the end of the window or file. */
+size_t readBlock( FILE *fp, unsigned char *buffer, unsigned long long *left )
+{
+  size_t n = *left < IN_SIZE ? *left : IN_SIZE;
+  n = fread( buffer, 1, n, fp );
+  *left -= n;
+  return n;
+}
+
+/** Parse a numeric option value, or exit with an error message. */
+unsigned long long parseNumber( char const *text )
+{
+  char *end;
+  unsigned long long value = strtoull( text, &end, 0 );
+  if ( *text == '\0' || *text == '-' || *end != '\0' ) {
+    fprintf( stderr, "Invalid number: %s\n", text );
+    exit( EXIT_FAILURE );
+  }
+  return value;
+}
+
+/** Print every byte in the window of a file. */
+void dump( FILE *fp, unsigned long long idx, unsigned long long left )
+{
+  unsigned char buffer[ IN_SIZE ];
+  size_t n;
+  while ( ( n = readBlock( fp, buffer, &left ) ) > 0 ) {
+    for ( size_t i = 0; i < n; i++ ) {
+      // Print byte index, followed by its binary representation.
+      putIndex( idx++ );
+      putBits( buffer[ i ] );
+      out[ outLen++ ] = '\n';
+    }
+  }
+}
+
+/** Print the bytes where the windows of two files differ. */
+void compare( FILE *a, FILE *b, unsigned long long idx,
+              unsigned long long left )
+{
+  unsigned char bufA[ IN_SIZE ], bufB[ IN_SIZE ];
+  unsigned long long leftA = left, leftB = left;
+  size_t nA, nB;
+  do {
+    nA = readBlock( a, bufA, &leftA );
+    nB = readBlock( b, bufB, &leftB );
+    size_t n = nA > nB ? nA : nB;
+
+    // Most blocks match, so skip them without looking at each byte.
+    if ( nA == nB && memcmp( bufA, bufB, n ) == 0 ) {
+      idx += n;
+      continue;
+    }
+    for ( size_t i = 0; i < n; i++ ) {
+      int chA = i < nA ? bufA[ i ] : EOF;
+      int chB = i < nB ? bufB[ i ] : EOF;
+      if ( chA != chB ) {
+        putIndex( idx );
+        putBits( chA );
+        out[ outLen++ ] = ' ';
+        putBits( chB );
+        out[ outLen++ ] = '\n';
+      }
+      idx++;
+    }
+  } while ( nA > 0 || nB > 0 );
+}
+
+int main( int argc, char *argv[] )
+{
+  unsigned long long offset = 0;
+  unsigned long long length = -1;
+  while ( argc > 1 && strncmp( argv[ 1 ], "--", 2 ) == 0 ) {
+    if ( strncmp( argv[ 1 ], OFFSET_OPT, strlen( OFFSET_OPT ) ) == 0 )
+      offset = parseNumber( argv[ 1 ] + strlen( OFFSET_OPT ) );
+    else if ( strncmp( argv[ 1 ], LENGTH_OPT, strlen( LENGTH_OPT ) ) == 0 )
+      length = parseNumber( argv[ 1 ] + strlen( LENGTH_OPT ) );
+    else
+      break;
+    argc--;
+    argv++;
+  }
+  if ( argc > 3 || ( argc > 1 && strncmp( argv[ 1 ], "--", 2 ) == 0 ) ) {
+    fprintf( stderr, "usage: dumpbits [--offset=N] [--length=N] "
+             "[file [other-file]]\n" );
+    exit( EXIT_FAILURE );
+  }
+  makeTable();
 
-  // Read the contents of input.
-  while ( ( ch = getchar() ) != EOF ) {
-    // Print byte index, followed by its binary representation.
-    printf( "%04x ", idx );
-    printBits( ch );
-    printf( "\n" );
-    idx++;
+  if ( argc == 3 ) {
+    FILE *a = openInput( argv[ 1 ] );
+    FILE *b = openInput( argv[ 2 ] );
+    skipTo( a, offset );
+    skipTo( b, offset );
+    compare( a, b, offset, length );
+    fclose( a );
+    fclose( b );
+  } else {
+    FILE *fp;
+    if ( argc == 2 ) {
+      fp = openInput( argv[ 1 ] );
+    } else {
+      // Normally, standard input will be in text mode, so it may not handle
+      // binary input well. This should fix that.
+      fp = freopen( NULL, "rb", stdin );
+      if ( !fp ) {
+        perror( "stdin" );
+        exit( EXIT_FAILURE );
+      }
+    }
+    skipTo( fp, offset );
+    dump( fp, offset, length );
+    fclose( fp );
   }
+  flushOut();
+  return EXIT_SUCCESS;
 }
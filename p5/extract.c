@@ -5,16 +5,58 @@
     This component will implement the main function of the extract program. It will be responsible
     for handling the command-line arguments and extracting the message characters from the input
     image.
+
+    The pixel data is streamed through a block at a time, starting with a small block and growing
+    up to BLOCK_SIZE, and reading stops as soon as the end of the message has been decoded. A short
+    message in a huge image only needs the first few pages of the file.
+
+    With the --threads=N option, blocks are allowed to grow to N times BLOCK_SIZE and are split
+    into ranges of whole packing groups that are unpacked on N threads at once. By default, there's
+    one thread for each processor. Small images get fewer threads, and the threads aren't started
+    and the buffers aren't grown until a block is big enough to need them.
+
+    With the --key=K option, the color bytes of each block are first gathered back into the order
+    conceal --key=K scattered the message into, using the same key.
+
+    With the --length option, the message is expected to start with the LENGTH_SIZE-byte header
+    written by conceal --length, which says exactly how many bytes to recover. The --check option
+    expects the CHECK_SIZE-byte header written by conceal --check instead. If the checksum of the
+    header itself is wrong, the image doesn't carry a checked message, and extract gives up after
+    decoding just the first block. The checksum of the message is computed as it's written out and
+    compared at the end.
  */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdbool.h>
 #include "bits.h"
 #include "image.h"
+#include "pool.h"
+#include "scatter.h"
+#include "crc.h"
 
 #define ARG_NUM 4
 #define OUTPUT_ARG 2
+#define LENGTH_OPT "--length"
+#define CHECK_OPT "--check"
+#define THREADS_OPT "--threads="
+#define KEY_OPT "--key="
+#define FIRST_BLOCK 4096
+
+/**
+    Removes a partly written output file, prints the given error message and terminates the
+    program.
+
+    @param outFile name of the output file to remove.
+    @param message error message to print.
+ */
+static void fail( char const *outFile, char const *message )
+{
+    remove( outFile );
+    fprintf( stderr, "%s\n", message );
+    exit( EXIT_FAILURE );
+}
 
 /**
     Program starting point.
@@ -25,8 +67,33 @@
  */
 int main( int argc, char *argv[] )
 {
+    size_t header = 0;
+    int threads = defaultThreads();
+    uint64_t keyValue;
+    uint64_t const *key = NULL;
+    while ( argc > 1 && strncmp( argv[ 1 ], "--", 2 ) == 0 ) {
+        if ( strcmp( argv[ 1 ], LENGTH_OPT ) == 0 ) {
+            header = header ? header : LENGTH_SIZE;
+        } else if ( strcmp( argv[ 1 ], CHECK_OPT ) == 0 ) {
+            header = CHECK_SIZE;
+        } else if ( strncmp( argv[ 1 ], KEY_OPT, strlen( KEY_OPT ) ) == 0 ) {
+            keyValue = scatterKey( argv[ 1 ] + strlen( KEY_OPT ) );
+            key = &keyValue;
+        } else if ( strncmp( argv[ 1 ], THREADS_OPT, strlen( THREADS_OPT ) ) == 0 ) {
+            threads = atoi( argv[ 1 ] + strlen( THREADS_OPT ) );
+            if ( threads < 1 ) {
+                fprintf( stderr, "Invalid number of threads\n" );
+                exit( EXIT_FAILURE );
+            }
+        } else {
+            break;
+        }
+        argc--;
+        argv++;
+    }
     if ( argc != ARG_NUM ) {
-        fprintf( stderr, "usage: extract <input-image> <output-message> <bits>\n" );
+        fprintf( stderr, "usage: extract [--length] [--check] [--key=K] [--threads=N] "
+                 "<input-image> <output-message> <bits>\n" );
         exit( EXIT_FAILURE );
     }
     int userNumBits = atoi( argv[ argc - 1 ] );
@@ -34,40 +101,122 @@ int main( int argc, char *argv[] )
         fprintf( stderr, "Invalid number of bits\n" );
         exit( EXIT_FAILURE );
     }
-    Image *image = readImage( argv[ 1 ] );
+    FILE *fp = fopen( argv[ 1 ], "rb" );
+    if ( !fp ) {
+        perror( argv[ 1 ] );
+        exit( EXIT_FAILURE );
+    }
+    Image image;
+    readHeader( fp, &image );
     FILE *dest = fopen( argv[ OUTPUT_ARG ], "w" );
     if ( !dest ) {
-        freeImage( image );
+        fclose( fp );
         perror( argv[ OUTPUT_ARG ] );
         exit( EXIT_FAILURE );
     }
-    int len = ( image->rows * image->cols * PIXEL_WIDTH * userNumBits ) / BITS_PER_BYTE;
-    char message[ len + 1 ];
-    for ( int i = 0; i < len + 1; i++ ) {
-        message[ i ] = '\0';
+    size_t size = imageSize( &image );
+
+    // Number of message bytes to recover, counting the header. Without a header, the message
+    // ends at the first null character, or when the image is full.
+    size_t limit = size * userNumBits / BITS_PER_BYTE;
+    if ( limit < header ) {
+        fclose( dest );
+        fail( argv[ OUTPUT_ARG ], "Invalid message length" );
+    }
+
+    // Blocks never need to be bigger than the image, rounded up to a whole scatter block.
+    threads = packingThreads( size, threads );
+    size_t maxBlock = (size_t) BLOCK_SIZE * threads;
+    if ( size < maxBlock ) {
+        maxBlock = ( size / SCATTER_SIZE + 1 ) * SCATTER_SIZE;
     }
-    int mPos = 0;
-    int bPos = 0;
-    for ( int i = 0; i < image->rows * image->cols * PIXEL_WIDTH; i++ ) {
-        for ( int j = 0; j < userNumBits; j++ ) {
-            message[ mPos ] = putBit( message[ mPos ], bPos++, getBit( image->color[ i ], j ) );
-            if ( bPos == BITS_PER_BYTE ) {
-                if ( message[ mPos ] == '\0' ) {
-                    goto done;
-                }
-                bPos = 0;
-                mPos++;
+    Pool *pool = NULL;
+    unsigned char *color = NULL, *message = NULL, *gathered = NULL;
+    size_t cap = 0;
+    size_t pos = 0;
+    uint32_t expected = 0, crc = 0;
+    size_t blockSize = FIRST_BLOCK;
+    for ( size_t start = 0; start < size && pos < limit; start += blockSize ) {
+        if ( start > 0 && blockSize < maxBlock ) {
+            blockSize = blockSize * 2 < maxBlock ? blockSize * 2 : maxBlock;
+        }
+        size_t count = size - start < blockSize ? size - start : blockSize;
+        if ( blockSize > cap ) {
+            cap = blockSize;
+            free( color );
+            free( message );
+            free( gathered );
+            color = (unsigned char *) malloc( cap );
+            message = (unsigned char *) malloc( cap + 1 );
+            gathered = key ? (unsigned char *) malloc( cap ) : NULL;
+            if ( !color || !message || ( key && !gathered ) ) {
+                fclose( dest );
+                fail( argv[ OUTPUT_ARG ], "Out of memory" );
             }
         }
+        if ( !pool && packingThreads( count, threads ) > 1 ) {
+            pool = makePool( threads );
+        }
+        if ( !readColor( fp, &image, color, count ) ) {
+            fclose( dest );
+            fail( argv[ OUTPUT_ARG ], "Invalid image file" );
+        }
+        // Every block starts on a scatter block, since block sizes are multiples of SCATTER_SIZE.
+        if ( key ) {
+            gatherScattered( gathered, color, start, count, *key );
+            extractBitsParallel( pool, gathered, count, message, userNumBits );
+        } else {
+            extractBitsParallel( pool, color, count, message, userNumBits );
+        }
+        size_t mCount = count * userNumBits / BITS_PER_BYTE;
+        if ( mCount > limit - pos ) {
+            mCount = limit - pos;
+        }
+
+        unsigned char *text = message;
+        if ( header && start == 0 ) {
+            // The first block always holds the whole header.
+            if ( header == CHECK_SIZE && !getCheck( message, &expected ) ) {
+                fclose( dest );
+                fail( argv[ OUTPUT_ARG ], "No checked message found" );
+            }
+            uint64_t length = getLength( message );
+            if ( length > limit - header ) {
+                fclose( dest );
+                fail( argv[ OUTPUT_ARG ], "Invalid message length" );
+            }
+            limit = header + length;
+            if ( mCount > limit ) {
+                mCount = limit;
+            }
+            text += header;
+            pos += header;
+            mCount -= header;
+        } else if ( !header ) {
+            unsigned char *end = memchr( text, '\0', mCount );
+            if ( end ) {
+                mCount = end - text;
+                limit = pos + mCount;
+            }
+        }
+        if ( header == CHECK_SIZE ) {
+            crc = crc32c( crc, text, mCount );
+        }
+        fwrite( text, sizeof( unsigned char ), mCount, dest );
+        pos += mCount;
     }
-    if ( strlen( message ) == len ) {
-        message[ mPos ] = '\0';
+    if ( header == CHECK_SIZE && crc != expected ) {
+        fclose( dest );
+        fail( argv[ OUTPUT_ARG ], "Message checksum mismatch" );
     }
-done:
-    for ( int i = 0; i < strlen( message ); i++ ) {
-        fprintf( dest, "%c", message[ i ] );
+    if ( pool ) {
+        freePool( pool );
     }
-    freeImage( image );
+    free( color );
+    free( message );
+    free( gathered );
+    clearImage( &image );
+    fclose( fp );
     fclose( dest );
     return EXIT_SUCCESS;
 }
@@ -2,18 +2,545 @@
     @file image.c
     @author Selena Chen (schen53)
 
-    This component contains functions to read and write images in Raw PPM format. It's used by the
-    conceal and extract programs.
+    This component contains functions to read and write images. It's used by the conceal and
+    extract programs.
+
+    Each file format is handled by a codec, which knows how to read and write the format's header
+    and how the pixel data is laid out: how many intensities there are per pixel, and what each
+    row is padded to. Everything after the header is read and written by the same code for every
+    format. Only the low-order byte of each intensity is a color byte, so for images with one byte
+    per intensity and no row padding, the color bytes are just the pixel data, and they're read
+    and written directly. Otherwise, the file bytes are read into a buffer and the color bytes
+    picked out of them, and the buffer is kept so the same bytes can be written back around the
+    new color bytes.
+
+    Programs that work through many images can keep reading them into the same Image with
+    readImageInto(), which only allocates when an image is bigger than any before it. Large color
+    buffers are aligned to huge pages, and the kernel is asked to back them with huge pages, so
+    the first image touches few pages and later ones reuse the same memory.
  */
 
+#define _DEFAULT_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/mman.h>
 #include "image.h"
+#include "bits.h"
 
-#define HEADER_ARGS 4
 #define STR_LENGTH 2
 
+/** Largest maximum intensity value for images with two bytes per intensity. */
+#define WIDE_MAX_COLOR 65535
+
+/** Size of a huge page. Color buffers at least this big are aligned to it and rounded up to a
+    whole number of them. */
+#define HUGE_PAGE_SIZE ( (size_t) 2 << 20 )
+
+/** Alignment of smaller color buffers, a cache line. */
+#define CACHE_LINE 64
+
+/** Size of the BMP file header plus the smallest BMP info header we support. */
+#define BMP_FIXED_SIZE 54
+
+/** Offsets of fields in the BMP headers. */
+#define BMP_OFFSET 10
+#define BMP_INFO_SIZE 14
+#define BMP_WIDTH 18
+#define BMP_HEIGHT 22
+#define BMP_PLANES 26
+#define BMP_BIT_COUNT 28
+#define BMP_COMPRESSION 30
+
+/** Size of the BMP file header. */
+#define BMP_FILE_HEADER 14
+
+/** Smallest BMP info header we support, the original BITMAPINFOHEADER. */
+#define BMP_INFO_HEADER 40
+
+/** Largest BMP header, including anything between it and the pixel data, we'll keep. */
+#define BMP_MAX_HEADER ( 1 << 20 )
+
+/** Bits per pixel in the BMP images we support. */
+#define BMP_BITS 24
+
+/** Rows of BMP pixel data are padded to a multiple of this many bytes. */
+#define BMP_ROW_ALIGN 4
+
+/** Description of an image file format. */
+struct CodecStruct {
+    /** String the file starts with. */
+    char const *magic;
+
+    /** True if the magic string is a whitespace-separated token, as in the PNM formats. */
+    bool token;
+
+    /** Number of intensities per pixel. */
+    int channels;
+
+    /** Rows of pixel data are padded to a multiple of this many bytes. */
+    int rowAlign;
+
+    /**
+        Reads the rest of the header, after the magic string, filling in the rows, cols and
+        maxColor fields of the image, and the header fields if the format needs them.
+
+        @param fp file to read from.
+        @param image Image to fill in.
+        @return true if the header was valid.
+     */
+    bool (*readHeader)( FILE *fp, Image *image );
+
+    /**
+        Writes a header for the image.
+
+        @param fp file to write to.
+        @param image Image to write a header for.
+     */
+    void (*writeHeader)( FILE *fp, Image *image );
+};
+
+/**
+    Reads the next whitespace-separated token of a PPM header into buf, skipping over any
+    comments, which run from a '#' to the end of the line. The character that ends the token is
+    consumed if it's whitespace, so after the last field of the header the stream is positioned
+    at the start of the pixel data.
+
+    @param fp file to read the header from.
+    @param buf buffer to store the token in.
+    @param size capacity of buf, including room for the null terminator.
+    @return length of the token, or 0 if there wasn't one or it didn't fit in buf.
+ */
+static int readToken( FILE *fp, char *buf, int size )
+{
+    int ch = getc( fp );
+    while ( ch == '#' || isspace( ch ) ) {
+        if ( ch == '#' ) {
+            while ( ( ch = getc( fp ) ) != EOF && ch != '\n' && ch != '\r' )
+                ;
+        }
+        ch = getc( fp );
+    }
+
+    int len = 0;
+    while ( ch != EOF && !isspace( ch ) && ch != '#' ) {
+        if ( len + 1 >= size ) {
+            return 0;
+        }
+        buf[ len++ ] = ch;
+        ch = getc( fp );
+    }
+    if ( ch == '#' ) {
+        ungetc( ch, fp );
+    }
+    buf[ len ] = '\0';
+    return len;
+}
+
+/**
+    Reads the next header token as a non-negative decimal integer.
+
+    @param fp file to read the header from.
+    @param val pointer to the integer to store the value in.
+    @return true if the token was a valid integer that fits in a size_t.
+ */
+static bool readNumber( FILE *fp, size_t *val )
+{
+    char buf[ 24 ];
+    if ( !readToken( fp, buf, sizeof( buf ) ) ) {
+        return false;
+    }
+    size_t n = 0;
+    for ( int i = 0; buf[ i ]; i++ ) {
+        if ( !isdigit( (unsigned char) buf[ i ] ) || n > ( SIZE_MAX - 9 ) / 10 ) {
+            return false;
+        }
+        n = n * 10 + buf[ i ] - '0';
+    }
+    *val = n;
+    return true;
+}
+
+/**
+    Reads the header of a PPM or PGM file, after the magic string. The maximum intensity can be
+    MAX_COLOR, or, for two bytes per intensity, anything up to WIDE_MAX_COLOR with all of its
+    low-order byte set, so any value of a color byte keeps the intensity in range.
+
+    @param fp file to read from.
+    @param image Image to fill in.
+    @return true if the header was valid.
+ */
+static bool readPnmHeader( FILE *fp, Image *image )
+{
+    size_t width, height, maxColor;
+    if ( !readNumber( fp, &width ) || !readNumber( fp, &height ) || !readNumber( fp, &maxColor )
+         || maxColor < MAX_COLOR || maxColor > WIDE_MAX_COLOR
+         || ( maxColor & MAX_COLOR ) != MAX_COLOR ) {
+        return false;
+    }
+    image->rows = height;
+    image->cols = width;
+    image->maxColor = maxColor;
+    return true;
+}
+
+/**
+    Writes a PPM or PGM header.
+
+    @param fp file to write to.
+    @param image Image to write a header for.
+ */
+static void writePnmHeader( FILE *fp, Image *image )
+{
+    fprintf( fp, "%s\n%zu %zu\n%d\n", image->codec->magic, image->cols, image->rows,
+             image->maxColor );
+}
+
+/**
+    Returns the little-endian 16-bit value at the given address.
+
+    @param p address of the value.
+    @return the value.
+ */
+static uint16_t getLe16( unsigned char const *p )
+{
+    return p[ 0 ] | p[ 1 ] << 8;
+}
+
+/**
+    Returns the little-endian 32-bit value at the given address.
+
+    @param p address of the value.
+    @return the value.
+ */
+static uint32_t getLe32( unsigned char const *p )
+{
+    return p[ 0 ] | p[ 1 ] << 8 | p[ 2 ] << 16 | (uint32_t) p[ 3 ] << 24;
+}
+
+/**
+    Reads the header of a BMP file, after the magic string. Only uncompressed 24-bit images are
+    supported. Everything up to the pixel data is kept, so it can be written back unchanged.
+    Images stored top-down and bottom-up are both fine, since the color bytes are taken in the
+    order they appear in the file.
+
+    @param fp file to read from.
+    @param image Image to fill in.
+    @return true if the header was valid.
+ */
+static bool readBmpHeader( FILE *fp, Image *image )
+{
+    unsigned char fixed[ BMP_FIXED_SIZE ];
+    memcpy( fixed, image->codec->magic, STR_LENGTH );
+    if ( fread( fixed + STR_LENGTH, 1, BMP_FIXED_SIZE - STR_LENGTH, fp )
+         != BMP_FIXED_SIZE - STR_LENGTH ) {
+        return false;
+    }
+    uint32_t offset = getLe32( fixed + BMP_OFFSET );
+    uint32_t infoSize = getLe32( fixed + BMP_INFO_SIZE );
+    int32_t width = (int32_t) getLe32( fixed + BMP_WIDTH );
+    int32_t height = (int32_t) getLe32( fixed + BMP_HEIGHT );
+    if ( infoSize < BMP_INFO_HEADER || infoSize > BMP_MAX_HEADER
+         || offset < BMP_FILE_HEADER + infoSize
+         || offset > BMP_MAX_HEADER || width < 0
+         || getLe16( fixed + BMP_PLANES ) != 1 || getLe16( fixed + BMP_BIT_COUNT ) != BMP_BITS
+         || getLe32( fixed + BMP_COMPRESSION ) != 0 ) {
+        return false;
+    }
+
+    image->header = (unsigned char *) malloc( offset );
+    image->headerSize = offset;
+    memcpy( image->header, fixed, BMP_FIXED_SIZE );
+    if ( fread( image->header + BMP_FIXED_SIZE, 1, offset - BMP_FIXED_SIZE, fp )
+         != offset - BMP_FIXED_SIZE ) {
+        return false;
+    }
+    image->rows = height < 0 ? -(int64_t) height : height;
+    image->cols = width;
+    image->maxColor = MAX_COLOR;
+    return true;
+}
+
+/**
+    Writes a BMP header, the same bytes that were read from the original image.
+
+    @param fp file to write to.
+    @param image Image to write a header for.
+ */
+static void writeBmpHeader( FILE *fp, Image *image )
+{
+    fwrite( image->header, 1, image->headerSize, fp );
+}
+
+/** The supported formats. */
+static Codec const codecs[] = {
+    { "P6", true, PIXEL_WIDTH, 1, readPnmHeader, writePnmHeader },
+    { "P5", true, 1, 1, readPnmHeader, writePnmHeader },
+    { "BM", false, PIXEL_WIDTH, BMP_ROW_ALIGN, readBmpHeader, writeBmpHeader },
+};
+
+/**
+    Reads the magic string at the start of an image file and returns the codec for its format.
+
+    @param fp file to read from.
+    @return codec for the file's format, or NULL if it isn't one we support.
+ */
+static Codec const *findCodec( FILE *fp )
+{
+    char magic[ STR_LENGTH + 1 ] = "";
+    int ch = getc( fp );
+    ungetc( ch, fp );
+    bool token = ch == 'P' || ch == '#' || isspace( ch );
+    if ( token ) {
+        if ( readToken( fp, magic, sizeof( magic ) ) != STR_LENGTH ) {
+            return NULL;
+        }
+    } else if ( fread( magic, 1, STR_LENGTH, fp ) != STR_LENGTH ) {
+        return NULL;
+    }
+    for ( int i = 0; i < sizeof( codecs ) / sizeof( codecs[ 0 ] ); i++ ) {
+        if ( codecs[ i ].token == token && strcmp( codecs[ i ].magic, magic ) == 0 ) {
+            return &codecs[ i ];
+        }
+    }
+    return NULL;
+}
+
+/**
+    Returns the number of bytes each intensity of an image takes in the file.
+
+    @param image Image to check.
+    @return 1 or 2.
+ */
+static int sampleBytes( Image const *image )
+{
+    return image->maxColor > MAX_COLOR ? 2 : 1;
+}
+
+size_t rawOffset( Image const *image, size_t index )
+{
+    size_t row = image->cols * image->channels;
+    return row == 0 ? 0 : index / row * image->stride + index % row * sampleBytes( image );
+}
+
+bool colorIsRaw( Image const *image )
+{
+    return image->stride == image->cols * image->channels;
+}
+
+void unpackColor( Image const *image, unsigned char const *raw, unsigned char *color,
+                  size_t start, size_t count )
+{
+    if ( colorIsRaw( image ) ) {
+        memcpy( color, raw, count );
+        return;
+    }
+
+    // Pick out the low-order byte of each intensity, skipping the padding at the end of a row.
+    int bytes = sampleBytes( image );
+    size_t row = image->cols * image->channels;
+    size_t col = start % row;
+    unsigned char const *p = raw + bytes - 1;
+    for ( size_t i = 0; i < count; i++ ) {
+        color[ i ] = *p;
+        p += bytes;
+        if ( ++col == row ) {
+            col = 0;
+            p += image->stride - row * bytes;
+        }
+    }
+}
+
+void packColor( Image const *image, unsigned char *raw, unsigned char const *color,
+                size_t start, size_t count )
+{
+    if ( colorIsRaw( image ) ) {
+        memcpy( raw, color, count );
+        return;
+    }
+
+    // Put the color bytes back into the file bytes they were read from.
+    int bytes = sampleBytes( image );
+    size_t row = image->cols * image->channels;
+    size_t col = start % row;
+    unsigned char *p = raw + bytes - 1;
+    for ( size_t i = 0; i < count; i++ ) {
+        *p = color[ i ];
+        p += bytes;
+        if ( ++col == row ) {
+            col = 0;
+            p += image->stride - row * bytes;
+        }
+    }
+}
+
+/**
+    Makes sure the image's raw buffer can hold at least the given number of bytes.
+
+    @param image Image whose buffer is needed.
+    @param size number of bytes needed.
+ */
+static void reserveRaw( Image *image, size_t size )
+{
+    if ( size > image->rawCap ) {
+        free( image->raw );
+        image->rawCap = size;
+        image->raw = (unsigned char *) malloc( size );
+    }
+}
+
+/**
+    Makes sure the image's color buffer can hold at least the given number of bytes, replacing it
+    with a bigger, suitably aligned one if needed. The old contents aren't kept.
+
+    @param image Image whose color buffer should be grown.
+    @param size number of color bytes needed.
+    @return true if the buffer is big enough, false if it couldn't be allocated.
+ */
+static bool reserveColor( Image *image, size_t size )
+{
+    if ( size <= image->colorCap ) {
+        return true;
+    }
+    free( image->color );
+    image->color = NULL;
+    image->colorCap = 0;
+
+    size_t align = size < HUGE_PAGE_SIZE ? CACHE_LINE : HUGE_PAGE_SIZE;
+    size_t cap = ( size + align - 1 ) / align * align;
+    void *color;
+    if ( posix_memalign( &color, align, cap ) != 0 ) {
+        return false;
+    }
+#ifdef MADV_HUGEPAGE
+    if ( align == HUGE_PAGE_SIZE ) {
+        // Just a hint; without transparent huge pages the buffer still works.
+        madvise( color, cap, MADV_HUGEPAGE );
+    }
+#endif
+    image->color = (unsigned char *) color;
+    image->colorCap = cap;
+    return true;
+}
+
+size_t imageSize( Image const *image )
+{
+    return image->rows * image->cols * image->channels;
+}
+
+size_t colorOffset( Image const *image, size_t index )
+{
+    return rawOffset( image, index ) + sampleBytes( image ) - 1;
+}
+
+bool scanHeader( FILE *fp, Image *image )
+{
+    image->header = image->raw = NULL;
+    image->headerSize = image->rawCap = 0;
+    image->readPos = image->writePos = 0;
+    image->codec = findCodec( fp );
+    if ( !image->codec ) {
+        return false;
+    }
+    image->channels = image->codec->channels;
+    if ( !image->codec->readHeader( fp, image ) ) {
+        clearImage( image );
+        return false;
+    }
+
+    // Make sure the size of the pixel data, and the number of message bits the image can hold,
+    // fit in a size_t.
+    size_t limit = SIZE_MAX / BITS_PER_BYTE / 2;
+    size_t bytes = image->channels * sampleBytes( image );
+    if ( image->cols > limit / bytes ) {
+        clearImage( image );
+        return false;
+    }
+    size_t align = image->codec->rowAlign;
+    image->stride = ( image->cols * bytes + align - 1 ) / align * align;
+    if ( image->rows != 0 && image->stride > limit / image->rows ) {
+        clearImage( image );
+        return false;
+    }
+    return true;
+}
+
+void readHeader( FILE *fp, Image *image )
+{
+    if ( !scanHeader( fp, image ) ) {
+        fclose( fp );
+        fprintf( stderr, "Invalid image file\n" );
+        exit( EXIT_FAILURE );
+    }
+}
+
+void writeHeader( FILE *fp, Image *image )
+{
+    image->codec->writeHeader( fp, image );
+}
+
+bool readColor( FILE *fp, Image *image, unsigned char *color, size_t count )
+{
+    if ( colorIsRaw( image ) ) {
+        image->readPos += count;
+        return fread( color, sizeof( unsigned char ), count, fp ) == count;
+    }
+
+    size_t start = rawOffset( image, image->readPos );
+    size_t len = rawOffset( image, image->readPos + count ) - start;
+    reserveRaw( image, len );
+    if ( fread( image->raw, sizeof( unsigned char ), len, fp ) != len ) {
+        return false;
+    }
+    unpackColor( image, image->raw, color, image->readPos, count );
+    image->readPos += count;
+    return true;
+}
+
+bool writeColor( FILE *fp, Image *image, unsigned char const *color, size_t count )
+{
+    if ( colorIsRaw( image ) ) {
+        image->writePos += count;
+        return fwrite( color, sizeof( unsigned char ), count, fp ) == count;
+    }
+
+    size_t start = rawOffset( image, image->writePos );
+    size_t len = rawOffset( image, image->writePos + count ) - start;
+    packColor( image, image->raw, color, image->writePos, count );
+    image->writePos += count;
+    return fwrite( image->raw, sizeof( unsigned char ), len, fp ) == len;
+}
+
+void initImage( Image *image )
+{
+    memset( image, 0, sizeof( Image ) );
+}
+
+bool readImageInto( FILE *fp, Image *image )
+{
+    // scanHeader() starts the codec's buffers over, so hold on to the raw buffer and put it back
+    // afterward.
+    unsigned char *raw = image->raw;
+    size_t rawCap = image->rawCap;
+    free( image->header );
+    bool ok = scanHeader( fp, image );
+    image->raw = raw;
+    image->rawCap = rawCap;
+    if ( !ok ) {
+        image->header = NULL;
+        image->headerSize = 0;
+        return false;
+    }
+
+    // Read all the pixel data in one call, straight into the image.
+    size_t size = imageSize( image );
+    return reserveColor( image, size ) && readColor( fp, image, image->color, size );
+}
+
 Image *readImage(char const *filename)
 {
     FILE *fp = fopen( filename, "rb" );
@@ -21,29 +548,14 @@ Image *readImage(char const *filename)
         perror( filename );
         exit( EXIT_FAILURE );
     }
-    char p6[ STR_LENGTH ];
-    int width, height;
-    int pixelMax;
-    if ( fscanf( fp, "%s %d %d %d%*c", p6, &width, &height, &pixelMax ) != HEADER_ARGS
-        || strncmp( FORMAT, p6, STR_LENGTH ) != 0
-        || width < 0 || height < 0 || pixelMax != MAX_COLOR ) {
+    Image *image = (Image *) malloc( sizeof( Image ) );
+    initImage( image );
+    if ( !readImageInto( fp, image ) ) {
         fclose( fp );
+        freeImage( image );
         fprintf( stderr, "Invalid image file\n" );
         exit( EXIT_FAILURE );
     }
-    Image *image = (Image *) malloc( sizeof( Image ) );
-    image->rows = height;
-    image->cols = width;
-    image->color = (unsigned char *) malloc( PIXEL_WIDTH * width * height
-                                            * sizeof( unsigned char ) );
-    for ( int i = 0; i < PIXEL_WIDTH * width * height; i++ ) {
-        if ( fread( &image->color[ i ], sizeof( unsigned char ), 1, fp ) != 1 ) {
-            fclose( fp );
-            freeImage( image );
-            fprintf( stderr, "Invalid image file\n" );
-            exit( EXIT_FAILURE );
-        }
-    }
     fclose( fp );
     return image;
 }
@@ -55,13 +567,32 @@ void writeImage( Image *image, char const *filename )
         perror( filename );
         exit( EXIT_FAILURE );
     }
-    fprintf( fp, "P6\n%d %d\n255\n", image->cols, image->rows );
-    fwrite( image->color, sizeof( unsigned char ), image->rows * image->cols * PIXEL_WIDTH, fp );
-    fclose( fp );
+    writeHeader( fp, image );
+    image->writePos = 0;
+    if ( !writeColor( fp, image, image->color, imageSize( image ) ) || fclose( fp ) != 0 ) {
+        perror( filename );
+        exit( EXIT_FAILURE );
+    }
 }
 
-void freeImage( Image *image )
+void clearImage( Image *image )
+{
+    free( image->header );
+    free( image->raw );
+    image->header = image->raw = NULL;
+    image->headerSize = image->rawCap = 0;
+}
+
+void releaseImage( Image *image )
 {
+    clearImage( image );
     free( image->color );
+    image->color = NULL;
+    image->colorCap = 0;
+}
+
+void freeImage( Image *image )
+{
+    releaseImage( image );
     free( image );
 }
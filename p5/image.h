@@ -3,54 +3,265 @@
     @author Selena Chen (schen53)
 
     Header for the image component, with a representation for an Image
-    and functions for reading and writing images in PPM format.
+    and functions for reading and writing images. Several file formats are
+    supported through codecs: Raw PPM (P6) and PGM (P5), with 8 or 16-bit
+    intensities, and uncompressed 24-bit BMP.
  */
 
 #ifndef _IMAGE_H_
 #define _IMAGE_H_
 
-/** PPM file format string. */
-#define FORMAT "P6"
+#include <stdio.h>
+#include <stddef.h>
+#include <stdbool.h>
 
-/** Maximum color value. */
+/** Maximum color value of an image with one byte per intensity. */
 #define MAX_COLOR 255
 
-/** Number of intensity values per pixel. */
+/** Number of intensity values per pixel in a color image. */
 #define PIXEL_WIDTH 3
 
+/** Number of color bytes conceal and extract work on at a time when streaming an image.  This
+    is a multiple of GROUP_SIZE, so every block but the last holds a whole number of message
+    bytes. */
+#define BLOCK_SIZE ( 1 << 20 )
+
+/** Short name for the codec type, describing one image file format. */
+typedef struct CodecStruct Codec;
+
 /** Representation for image file data. */
 typedef struct {
   /** number of rows. */
-  int rows;
-  
+  size_t rows;
+
   /** pixels per row. */
-  int cols;
-  
+  size_t cols;
+
   /** Dynamically allocated pixel data, rows * cols pixels, each with
-      3 intensities (RGB), stored in row-major order. */
+      channels intensities, stored in the order they appear in the
+      file.  These are the color bytes that carry message bits. */
   unsigned char *color;
+
+  /** Capacity of the color buffer, for images read with
+      readImageInto(), or 0 if the buffer belongs to the caller. */
+  size_t colorCap;
+
+  /** Format the image was read in, and will be written in. */
+  Codec const *codec;
+
+  /** Number of intensities per pixel, PIXEL_WIDTH for color images
+      and 1 for grayscale. */
+  int channels;
+
+  /** Maximum intensity value.  Above MAX_COLOR, each intensity takes
+      two bytes in the file, most significant first, and only the
+      low-order byte is used as a color byte. */
+  int maxColor;
+
+  /** Number of bytes each row of pixels takes in the file, including
+      any padding. */
+  size_t stride;
+
+  /** Bytes before the pixel data that are written back unchanged, for
+      formats that need them. */
+  unsigned char *header;
+  size_t headerSize;
+
+  /** File bytes for the color bytes read most recently, for formats
+      where they aren't just the color bytes, and their capacity. */
+  unsigned char *raw;
+  size_t rawCap;
+
+  /** Number of color bytes read and written so far. */
+  size_t readPos, writePos;
 } Image;
 
+/**
+    This function returns the number of color bytes in an image, rows * cols * channels.
+    scanHeader() only accepts images small enough that this, times BITS_PER_BYTE, fits in a
+    size_t, so callers can count message bits without overflowing.
+
+    @param image Image to measure.
+    @return number of color bytes.
+ */
+size_t imageSize( Image const *image );
+
+/**
+    This function returns the offset of a color byte in the file, counting from the start of the
+    pixel data. For images with one byte per intensity and no row padding, that's just the index.
+
+    @param image Image the color byte belongs to.
+    @param index index of the color byte.
+    @return offset of the color byte from the start of the pixel data.
+ */
+size_t colorOffset( Image const *image, size_t index );
+
+/**
+    This function returns the offset of the file bytes holding a color byte, counting from the
+    start of the pixel data. The file bytes for a block of color bytes run from the offset of its
+    first color byte up to the offset of the color byte after its last; for index imageSize(),
+    that's the size of the pixel data, including any padding at the end.
+
+    @param image Image the color byte belongs to.
+    @param index index of the color byte, up to imageSize().
+    @return offset of the start of its intensity from the start of the pixel data.
+ */
+size_t rawOffset( Image const *image, size_t index );
+
+/**
+    This function reports whether the color bytes of an image are exactly its pixel data, with one
+    byte per intensity and no row padding, so file bytes can be used as color bytes without being
+    unpacked.
+
+    @param image Image to check.
+    @return true if the pixel data is just the color bytes.
+ */
+bool colorIsRaw( Image const *image );
+
+/**
+    This function picks the color bytes out of a block of the image's pixel data, as read from the
+    file. readColor() does this for sequential reads; it's exposed for callers that do their own
+    I/O.
+
+    @param image Image the pixel data belongs to.
+    @param raw file bytes, starting at rawOffset( image, start ).
+    @param color buffer to store the color bytes in.
+    @param start index of the first color byte.
+    @param count number of color bytes.
+ */
+void unpackColor( Image const *image, unsigned char const *raw, unsigned char *color,
+                  size_t start, size_t count );
+
+/**
+    This function puts color bytes back into the block of pixel data they were unpacked from,
+    leaving the other file bytes alone.
+
+    @param image Image the pixel data belongs to.
+    @param raw file bytes, starting at rawOffset( image, start ).
+    @param color color bytes to store.
+    @param start index of the first color byte.
+    @param count number of color bytes.
+ */
+void packColor( Image const *image, unsigned char *raw, unsigned char const *color,
+                size_t start, size_t count );
+
+/**
+    This function reads the header of an image file, figuring out its format and filling in the
+    dimensions and layout fields of the given image, and leaving the file positioned at the start
+    of the pixel data. Unlike readHeader(), it just reports whether the header was valid, so a
+    program working on many images can carry on after a bad one. If the header is valid,
+    clearImage() should be called when the image is done with.
+
+    @param fp file to read the header from.
+    @param image Image to store the dimensions in; its pixel data isn't touched.
+    @return true if the header was valid.
+ */
+bool scanHeader( FILE *fp, Image *image );
+
+/**
+    This function reads the header of an image file, filling in the dimensions and layout fields
+    of the given image and leaving the file positioned at the start of the pixel data. If the
+    header isn't valid, it closes the file, prints an appropriate error message and terminates
+    the program.
+
+    @param fp file to read the header from.
+    @param image Image to store the dimensions in; its pixel data isn't touched.
+ */
+void readHeader( FILE *fp, Image *image );
+
+/**
+    This function writes a header for an image with the format and dimensions of the given image.
+    The pixel data can then be written right after it.
+
+    @param fp file to write the header to.
+    @param image Image whose format and dimensions go in the header.
+ */
+void writeHeader( FILE *fp, Image *image );
+
+/**
+    This function reads the next count color bytes of an image, picking them out of the file's
+    pixel data, which is read sequentially.
+
+    @param fp file to read from, positioned where the previous read left off.
+    @param image Image being read.
+    @param color buffer to store the color bytes in.
+    @param count number of color bytes to read.
+    @return true if all of them could be read.
+ */
+bool readColor( FILE *fp, Image *image, unsigned char *color, size_t count );
+
+/**
+    This function writes the next count color bytes of an image. For formats where the file holds
+    more than the color bytes, the rest comes from the most recent readColor() call, which must
+    have read the same color bytes, so the pixel data is streamed by reading and writing each block
+    in turn.
+
+    @param fp file to write to.
+    @param image Image being written.
+    @param color color bytes to write.
+    @param count number of color bytes to write.
+    @return true if they were written successfully.
+ */
+bool writeColor( FILE *fp, Image *image, unsigned char const *color, size_t count );
+
+/**
+    This function initializes an Image with no pixel data or buffers, ready to be passed to
+    readImageInto().
+
+    @param image Image to initialize.
+ */
+void initImage( Image *image );
+
+/**
+    This function reads an image file into an existing Image, reusing its color buffer and the
+    codec's buffers from any image read into it before, and only growing them when this image
+    needs more room. Reading many images of the same size into one Image makes no large
+    allocations after the first. Unlike readImage(), it just reports whether the image was valid.
+    releaseImage() frees the buffers when the Image is done with.
+
+    @param fp file to read from, positioned at the start of the image.
+    @param image Image to read into, initialized with initImage().
+    @return true if the image was read successfully.
+ */
+bool readImageInto( FILE *fp, Image *image );
+
 /**
     This function dynamically allocates an instance of Image and populates it based on the given
-    PPM file. If it encounters problems with the format of the image file, it prints an appropriate
-    error message and terminates the program.
+    image file. If it encounters problems with the format of the image file, it prints an
+    appropriate error message and terminates the program.
 
     @param filename name of the file to read image information from.
     @return dynamically allocated instance of Image populated with the information from the given
-            PPM file.
+            image file.
  */
 Image *readImage(char const *filename);
 
 /**
-    This function writes out the given image in Raw PPM format to a file with the given name. It
-    will print an error message and terminate the program if the given file can't be opened.
+    This function writes out the given image, in the format it was read in, to a file with the
+    given name. It will print an error message and terminate the program if the given file can't
+    be opened.
 
     @param image Image to be written.
     @param filename name of the file to write Image to.
  */
 void writeImage( Image *image, char const *filename );
 
+/**
+    This function frees the memory the codec keeps for an image, but not its pixel data or the
+    Image struct itself.
+
+    @param image Image to clear.
+ */
+void clearImage( Image *image );
+
+/**
+    This function frees the pixel data of an Image read with readImageInto(), along with the
+    memory the codec keeps for it, but not the Image struct itself.
+
+    @param image Image to release.
+ */
+void releaseImage( Image *image );
+
 /**
     This function frees all the memory associated with an image representation, including the pixel
     data and the Image struct itself.
@@ -0,0 +1,468 @@
+/**
+    @file ioqueue.c
+    @author Selena Chen (schen53)
+
+    This component implements the I/O queue. Reads and writes are each kept in a ring of IO_DEPTH
+    requests and are waited for in the order they were submitted.
+
+    With io_uring, each request becomes one submission queue entry, handed to the kernel right
+    away, and completions are matched back to their requests through the entry's user data. The
+    rings are set up with the raw system calls, since liburing isn't assumed to be installed. If a
+    transfer comes back short, the rest is done with an ordinary pread() or pwrite() when it's
+    waited for. Kernels that have io_uring but not its read and write operations, before 5.6, use
+    the thread pair instead, and a request the kernel turns down as unsupported is redone the
+    ordinary way.
+
+    Without io_uring, a reader thread and a writer thread each work through their own requests in
+    order with pread() and pwrite(), so a read and a write can still be in progress while the
+    caller works on a third buffer.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "ioqueue.h"
+
+#if defined( __linux__ ) && defined( __has_include )
+#if __has_include( <linux/io_uring.h> )
+#define HAVE_IO_URING
+#endif
+#endif
+
+#ifdef HAVE_IO_URING
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+
+/** Kinds of request, which index the request rings. */
+#define READ 0
+#define WRITE 1
+#define KINDS 2
+
+/** One read or write. */
+typedef struct {
+    int fd;
+    unsigned char *buf;
+    size_t len;
+    off_t offset;
+
+    /** True once the transfer is over, and whether all of it succeeded. */
+    bool done, ok;
+} Request;
+
+/** Representation for an I/O queue. */
+struct IoQueueStruct {
+    /** True if the queue is using io_uring, false for the thread pair. */
+    bool uring;
+
+    /** Rings of reads and writes, and how many of each have been submitted, finished and
+        waited for. */
+    Request requests[ KINDS ][ IO_DEPTH ];
+    unsigned long submitted[ KINDS ], finished[ KINDS ], waited[ KINDS ];
+
+#ifdef HAVE_IO_URING
+    /** The io_uring instance and its memory-mapped rings. */
+    int ringFd;
+    void *sqRing, *cqRing;
+    size_t sqRingSize, cqRingSize, sqesSize;
+    unsigned *sqTail, *sqMask, *sqArray;
+    unsigned *cqHead, *cqTail, *cqMask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+#endif
+
+    /** Reader and writer threads, for the fallback. */
+    pthread_t threads[ KINDS ];
+
+    /** Lock protecting the requests, for the fallback. */
+    pthread_mutex_t lock;
+
+    /** Signaled when a request is submitted or finished, or the threads should stop. */
+    pthread_cond_t changed;
+
+    /** True when the threads should exit. */
+    bool stop;
+};
+
+/** Argument for the reader or writer thread. */
+typedef struct {
+    IoQueue *queue;
+    int kind;
+} ThreadArg;
+
+/**
+    Reads or writes all of a request's bytes with ordinary system calls, starting from the given
+    number of bytes already done.
+
+    @param kind READ or WRITE.
+    @param req request to carry out.
+    @param done number of bytes already transferred.
+    @return true if all the bytes were transferred.
+ */
+static bool transfer( int kind, Request *req, size_t done )
+{
+    while ( done < req->len ) {
+        ssize_t n;
+        if ( kind == READ ) {
+            n = pread( req->fd, req->buf + done, req->len - done, req->offset + done );
+        } else {
+            n = pwrite( req->fd, req->buf + done, req->len - done, req->offset + done );
+        }
+        if ( n < 0 && errno == EINTR ) {
+            continue;
+        }
+        if ( n <= 0 ) {
+            return false;
+        }
+        done += n;
+    }
+    return true;
+}
+
+#ifdef HAVE_IO_URING
+
+/** Number of operations to ask about when probing io_uring. */
+#define PROBE_OPS 256
+
+/**
+    Checks that an io_uring instance supports the read and write operations. Kernels too old to
+    answer the probe don't have them either.
+
+    @param ringFd the io_uring instance.
+    @return true if both operations are supported.
+ */
+static bool probeUring( int ringFd )
+{
+    size_t size = sizeof( struct io_uring_probe ) + PROBE_OPS * sizeof( struct io_uring_probe_op );
+    struct io_uring_probe *probe = (struct io_uring_probe *) calloc( 1, size );
+    long n = syscall( __NR_io_uring_register, ringFd, IORING_REGISTER_PROBE, probe, PROBE_OPS );
+    bool ok = n >= 0 && probe->last_op >= IORING_OP_READ && probe->last_op >= IORING_OP_WRITE
+              && ( probe->ops[ IORING_OP_READ ].flags & IO_URING_OP_SUPPORTED )
+              && ( probe->ops[ IORING_OP_WRITE ].flags & IO_URING_OP_SUPPORTED );
+    free( probe );
+    return ok;
+}
+
+/**
+    Unmaps whichever of the queue's rings were mapped and closes its io_uring instance.
+
+    @param queue queue to shut down.
+ */
+static void stopUring( IoQueue *queue )
+{
+    if ( queue->sqes != MAP_FAILED ) {
+        munmap( queue->sqes, queue->sqesSize );
+    }
+    if ( queue->cqRing != MAP_FAILED && queue->cqRing != queue->sqRing ) {
+        munmap( queue->cqRing, queue->cqRingSize );
+    }
+    if ( queue->sqRing != MAP_FAILED ) {
+        munmap( queue->sqRing, queue->sqRingSize );
+    }
+    close( queue->ringFd );
+}
+
+/**
+    Sets up io_uring for the queue.
+
+    @param queue queue to set up.
+    @return true if io_uring is available and ready to use.
+ */
+static bool startUring( IoQueue *queue )
+{
+    struct io_uring_params params;
+    memset( &params, 0, sizeof( params ) );
+    queue->ringFd = syscall( __NR_io_uring_setup, KINDS * IO_DEPTH, &params );
+    if ( queue->ringFd < 0 ) {
+        return false;
+    }
+    if ( !probeUring( queue->ringFd ) ) {
+        close( queue->ringFd );
+        return false;
+    }
+
+    // With IORING_FEAT_SINGLE_MMAP, the submission and completion rings share one mapping.
+    queue->sqRingSize = params.sq_off.array + params.sq_entries * sizeof( unsigned );
+    queue->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof( struct io_uring_cqe );
+    bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+    if ( single && queue->cqRingSize > queue->sqRingSize ) {
+        queue->sqRingSize = queue->cqRingSize;
+    }
+    queue->sqRing = mmap( NULL, queue->sqRingSize, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, queue->ringFd, IORING_OFF_SQ_RING );
+    queue->cqRing = single ? queue->sqRing
+        : mmap( NULL, queue->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                queue->ringFd, IORING_OFF_CQ_RING );
+    queue->sqesSize = params.sq_entries * sizeof( struct io_uring_sqe );
+    queue->sqes = mmap( NULL, queue->sqesSize, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, queue->ringFd, IORING_OFF_SQES );
+    if ( queue->sqRing == MAP_FAILED || queue->cqRing == MAP_FAILED
+         || queue->sqes == MAP_FAILED ) {
+        stopUring( queue );
+        return false;
+    }
+
+    unsigned char *sq = (unsigned char *) queue->sqRing;
+    queue->sqTail = (unsigned *) ( sq + params.sq_off.tail );
+    queue->sqMask = (unsigned *) ( sq + params.sq_off.ring_mask );
+    queue->sqArray = (unsigned *) ( sq + params.sq_off.array );
+    unsigned char *cq = (unsigned char *) queue->cqRing;
+    queue->cqHead = (unsigned *) ( cq + params.cq_off.head );
+    queue->cqTail = (unsigned *) ( cq + params.cq_off.tail );
+    queue->cqMask = (unsigned *) ( cq + params.cq_off.ring_mask );
+    queue->cqes = (struct io_uring_cqe *) ( cq + params.cq_off.cqes );
+    return true;
+}
+
+/**
+    Hands a request to the kernel. If it can't be submitted, it's carried out right away instead.
+
+    @param queue queue the request belongs to.
+    @param kind READ or WRITE.
+    @param slot index of the request in its ring.
+ */
+static void submitUring( IoQueue *queue, int kind, int slot )
+{
+    Request *req = &queue->requests[ kind ][ slot ];
+    unsigned tail = *queue->sqTail;
+    unsigned index = tail & *queue->sqMask;
+    struct io_uring_sqe *sqe = &queue->sqes[ index ];
+    memset( sqe, 0, sizeof( *sqe ) );
+    sqe->opcode = kind == READ ? IORING_OP_READ : IORING_OP_WRITE;
+    sqe->fd = req->fd;
+    sqe->addr = (unsigned long) req->buf;
+    sqe->len = req->len;
+    sqe->off = req->offset;
+    sqe->user_data = kind * IO_DEPTH + slot;
+    queue->sqArray[ index ] = index;
+    __atomic_store_n( queue->sqTail, tail + 1, __ATOMIC_RELEASE );
+
+    int n;
+    do {
+        n = syscall( __NR_io_uring_enter, queue->ringFd, 1, 0, 0, NULL, 0 );
+    } while ( n < 0 && errno == EINTR );
+    if ( n < 1 ) {
+        // Take the entry back and do the transfer here.
+        __atomic_store_n( queue->sqTail, tail, __ATOMIC_RELEASE );
+        req->ok = transfer( kind, req, 0 );
+        req->done = true;
+    }
+}
+
+/**
+    Marks the requests whose completions have arrived as done.
+
+    @param queue queue to check.
+ */
+static void reapUring( IoQueue *queue )
+{
+    unsigned head = *queue->cqHead;
+    unsigned tail = __atomic_load_n( queue->cqTail, __ATOMIC_ACQUIRE );
+    for ( ; head != tail; head++ ) {
+        struct io_uring_cqe *cqe = &queue->cqes[ head & *queue->cqMask ];
+        int kind = cqe->user_data / IO_DEPTH;
+        Request *req = &queue->requests[ kind ][ cqe->user_data % IO_DEPTH ];
+        if ( cqe->res == -EINVAL || cqe->res == -EOPNOTSUPP ) {
+            // The kernel can't do this kind of transfer, so do all of it the ordinary way.
+            req->ok = transfer( kind, req, 0 );
+        } else if ( cqe->res < 0 ) {
+            req->ok = false;
+        } else {
+            // Finish a short transfer the ordinary way; a read that hit the end of the file
+            // fails there.
+            req->ok = transfer( kind, req, cqe->res );
+        }
+        req->done = true;
+    }
+    __atomic_store_n( queue->cqHead, head, __ATOMIC_RELEASE );
+}
+
+/**
+    Waits until a request is done.
+
+    @param queue queue the request belongs to.
+    @param req request to wait for.
+ */
+static void waitUring( IoQueue *queue, Request *req )
+{
+    reapUring( queue );
+    while ( !req->done ) {
+        syscall( __NR_io_uring_enter, queue->ringFd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0 );
+        reapUring( queue );
+    }
+}
+
+#endif
+
+/**
+    Main function for the reader or writer thread, carrying out requests of one kind in order
+    until the queue is freed.
+
+    @param p pointer to the ThreadArg for this thread, which it frees.
+    @return NULL.
+ */
+static void *ioThread( void *p )
+{
+    ThreadArg *targ = (ThreadArg *) p;
+    IoQueue *queue = targ->queue;
+    int kind = targ->kind;
+    free( targ );
+    Request *ring = queue->requests[ kind ];
+
+    pthread_mutex_lock( &queue->lock );
+    while ( true ) {
+        while ( !queue->stop && queue->finished[ kind ] == queue->submitted[ kind ] ) {
+            pthread_cond_wait( &queue->changed, &queue->lock );
+        }
+        if ( queue->stop ) {
+            break;
+        }
+        Request *req = &ring[ queue->finished[ kind ] % IO_DEPTH ];
+        pthread_mutex_unlock( &queue->lock );
+        bool ok = transfer( kind, req, 0 );
+        pthread_mutex_lock( &queue->lock );
+        req->ok = ok;
+        req->done = true;
+        queue->finished[ kind ]++;
+        pthread_cond_broadcast( &queue->changed );
+    }
+    pthread_mutex_unlock( &queue->lock );
+    return NULL;
+}
+
+IoQueue *makeIoQueue( void )
+{
+    IoQueue *queue = (IoQueue *) calloc( 1, sizeof( IoQueue ) );
+    char const *name = getenv( "IO_QUEUE" );
+#ifdef HAVE_IO_URING
+    if ( !name || strcmp( name, "threads" ) != 0 ) {
+        queue->uring = startUring( queue );
+    }
+#endif
+    if ( queue->uring ) {
+        return queue;
+    }
+
+    pthread_mutex_init( &queue->lock, NULL );
+    pthread_cond_init( &queue->changed, NULL );
+    for ( int kind = 0; kind < KINDS; kind++ ) {
+        ThreadArg *targ = (ThreadArg *) malloc( sizeof( ThreadArg ) );
+        targ->queue = queue;
+        targ->kind = kind;
+        if ( pthread_create( &queue->threads[ kind ], NULL, ioThread, targ ) != 0 ) {
+            fprintf( stderr, "Can't start I/O threads\n" );
+            exit( EXIT_FAILURE );
+        }
+    }
+    return queue;
+}
+
+char const *ioQueueName( IoQueue *queue )
+{
+    return queue->uring ? "uring" : "threads";
+}
+
+/**
+    Submits a read or write.
+
+    @param queue queue to run the request on.
+    @param kind READ or WRITE.
+    @param fd file to transfer to or from.
+    @param buf buffer to transfer from or to.
+    @param len number of bytes to transfer.
+    @param offset offset in the file.
+ */
+static void submit( IoQueue *queue, int kind, int fd, void *buf, size_t len, off_t offset )
+{
+    if ( !queue->uring ) {
+        pthread_mutex_lock( &queue->lock );
+    }
+    int slot = queue->submitted[ kind ] % IO_DEPTH;
+    Request *req = &queue->requests[ kind ][ slot ];
+    req->fd = fd;
+    req->buf = (unsigned char *) buf;
+    req->len = len;
+    req->offset = offset;
+    req->done = false;
+    queue->submitted[ kind ]++;
+#ifdef HAVE_IO_URING
+    if ( queue->uring ) {
+        submitUring( queue, kind, slot );
+        return;
+    }
+#endif
+    pthread_cond_broadcast( &queue->changed );
+    pthread_mutex_unlock( &queue->lock );
+}
+
+void submitRead( IoQueue *queue, int fd, void *buf, size_t len, off_t offset )
+{
+    submit( queue, READ, fd, buf, len, offset );
+}
+
+void submitWrite( IoQueue *queue, int fd, void const *buf, size_t len, off_t offset )
+{
+    submit( queue, WRITE, fd, (void *) buf, len, offset );
+}
+
+/**
+    Waits for the oldest request of one kind that hasn't been waited for.
+
+    @param queue queue the request is running on.
+    @param kind READ or WRITE.
+    @return true if all of its bytes were transferred.
+ */
+static bool waitFor( IoQueue *queue, int kind )
+{
+    Request *req = &queue->requests[ kind ][ queue->waited[ kind ]++ % IO_DEPTH ];
+#ifdef HAVE_IO_URING
+    if ( queue->uring ) {
+        waitUring( queue, req );
+        return req->ok;
+    }
+#endif
+    pthread_mutex_lock( &queue->lock );
+    while ( !req->done ) {
+        pthread_cond_wait( &queue->changed, &queue->lock );
+    }
+    bool ok = req->ok;
+    pthread_mutex_unlock( &queue->lock );
+    return ok;
+}
+
+bool waitRead( IoQueue *queue )
+{
+    return waitFor( queue, READ );
+}
+
+bool waitWrite( IoQueue *queue )
+{
+    return waitFor( queue, WRITE );
+}
+
+void freeIoQueue( IoQueue *queue )
+{
+#ifdef HAVE_IO_URING
+    if ( queue->uring ) {
+        stopUring( queue );
+        free( queue );
+        return;
+    }
+#endif
+    pthread_mutex_lock( &queue->lock );
+    queue->stop = true;
+    pthread_cond_broadcast( &queue->changed );
+    pthread_mutex_unlock( &queue->lock );
+    for ( int kind = 0; kind < KINDS; kind++ ) {
+        pthread_join( queue->threads[ kind ], NULL );
+    }
+    pthread_mutex_destroy( &queue->lock );
+    pthread_cond_destroy( &queue->changed );
+    free( queue );
+}
@@ -0,0 +1,91 @@
+/**
+    @file ioqueue.h
+    @author Selena Chen (schen53)
+
+    Header for the ioqueue component, which runs positioned reads and writes in the background,
+    so a program can work on one block of a file while the next is read and the previous one is
+    written. On Linux it uses io_uring; where that isn't available, it falls back to a reader
+    thread and a writer thread.
+ */
+
+#ifndef _IOQUEUE_H_
+#define _IOQUEUE_H_
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+/** Largest number of reads, and of writes, that can be in progress at once. */
+#define IO_DEPTH 4
+
+/** Short name for the I/O queue type. */
+typedef struct IoQueueStruct IoQueue;
+
+/**
+    This function makes an I/O queue. The IO_QUEUE environment variable can be set to uring or
+    threads to pick an implementation; by default io_uring is used if the kernel supports it. If
+    neither can be started, it prints an error message and terminates the program.
+
+    @return dynamically allocated I/O queue.
+ */
+IoQueue *makeIoQueue( void );
+
+/**
+    This function returns the name of the implementation a queue is using, uring or threads.
+
+    @param queue queue to ask about.
+    @return name of its implementation.
+ */
+char const *ioQueueName( IoQueue *queue );
+
+/**
+    This function starts reading len bytes at the given offset of a file into a buffer, which
+    shouldn't be touched until waitRead() says the read is done. At most IO_DEPTH reads can be in
+    progress at once.
+
+    @param queue queue to run the read on.
+    @param fd file to read from.
+    @param buf buffer to read into.
+    @param len number of bytes to read.
+    @param offset offset in the file to read from.
+ */
+void submitRead( IoQueue *queue, int fd, void *buf, size_t len, off_t offset );
+
+/**
+    This function starts writing len bytes from a buffer at the given offset of a file. The buffer
+    shouldn't be changed until waitWrite() says the write is done. At most IO_DEPTH writes can be
+    in progress at once.
+
+    @param queue queue to run the write on.
+    @param fd file to write to.
+    @param buf bytes to write.
+    @param len number of bytes to write.
+    @param offset offset in the file to write at.
+ */
+void submitWrite( IoQueue *queue, int fd, void const *buf, size_t len, off_t offset );
+
+/**
+    This function waits for the oldest read that hasn't been waited for to finish.
+
+    @param queue queue the read is running on.
+    @return true if all the bytes were read, false on an error or the end of the file.
+ */
+bool waitRead( IoQueue *queue );
+
+/**
+    This function waits for the oldest write that hasn't been waited for to finish.
+
+    @param queue queue the write is running on.
+    @return true if all the bytes were written.
+ */
+bool waitWrite( IoQueue *queue );
+
+/**
+    This function frees an I/O queue. Every read and write submitted to it should have been waited
+    for.
+
+    @param queue queue to free.
+ */
+void freeIoQueue( IoQueue *queue );
+
+#endif
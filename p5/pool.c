@@ -0,0 +1,163 @@
+/**
+    @file pool.c
+    @author Selena Chen (schen53)
+
+    This component implements a simple thread pool. The workers sleep on a condition variable
+    until runPool() hands them a batch of tasks, then take task numbers from a shared counter
+    until the batch is used up. It's used by the batch tool and for splitting one large image
+    across threads.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "pool.h"
+
+/** Representation for a thread pool. */
+struct PoolStruct {
+    /** Number of worker threads. */
+    int threads;
+
+    /** The worker threads. */
+    pthread_t *workers;
+
+    /** Lock protecting all the fields below. */
+    pthread_mutex_t lock;
+
+    /** Signaled when a new batch is ready, or the pool is shutting down. */
+    pthread_cond_t ready;
+
+    /** Signaled when the last task of a batch finishes. */
+    pthread_cond_t finished;
+
+    /** Function and argument for the current batch. */
+    PoolTask task;
+    void *arg;
+
+    /** Next task to hand out, and number of tasks in the batch. */
+    size_t next, count;
+
+    /** Number of tasks of the batch still running or waiting. */
+    size_t remaining;
+
+    /** Counts batches, so workers can tell a new one from the one they just finished. */
+    unsigned long batch;
+
+    /** True when the workers should exit. */
+    bool stop;
+};
+
+/** Argument for a worker thread. */
+typedef struct {
+    Pool *pool;
+    int thread;
+} WorkerArg;
+
+/**
+    Main function for a worker thread, running tasks from each batch until the pool is freed.
+
+    @param p pointer to the WorkerArg for this thread, which it frees.
+    @return NULL.
+ */
+static void *worker( void *p )
+{
+    WorkerArg *warg = (WorkerArg *) p;
+    Pool *pool = warg->pool;
+    int thread = warg->thread;
+    free( warg );
+
+    unsigned long seen = 0;
+    pthread_mutex_lock( &pool->lock );
+    while ( true ) {
+        while ( !pool->stop && pool->batch == seen ) {
+            pthread_cond_wait( &pool->ready, &pool->lock );
+        }
+        if ( pool->stop ) {
+            break;
+        }
+        seen = pool->batch;
+        while ( pool->next < pool->count ) {
+            size_t index = pool->next++;
+            pthread_mutex_unlock( &pool->lock );
+            pool->task( pool->arg, index, thread );
+            pthread_mutex_lock( &pool->lock );
+            if ( --pool->remaining == 0 ) {
+                pthread_cond_signal( &pool->finished );
+            }
+        }
+    }
+    pthread_mutex_unlock( &pool->lock );
+    return NULL;
+}
+
+Pool *makePool( int threads )
+{
+    Pool *pool = (Pool *) malloc( sizeof( Pool ) );
+    pool->threads = threads;
+    pool->workers = (pthread_t *) malloc( threads * sizeof( pthread_t ) );
+    pthread_mutex_init( &pool->lock, NULL );
+    pthread_cond_init( &pool->ready, NULL );
+    pthread_cond_init( &pool->finished, NULL );
+    pool->next = pool->count = pool->remaining = 0;
+    pool->batch = 0;
+    pool->stop = false;
+    for ( int i = 0; i < threads; i++ ) {
+        WorkerArg *warg = (WorkerArg *) malloc( sizeof( WorkerArg ) );
+        warg->pool = pool;
+        warg->thread = i;
+        if ( pthread_create( &pool->workers[ i ], NULL, worker, warg ) != 0 ) {
+            fprintf( stderr, "Can't start worker threads\n" );
+            exit( EXIT_FAILURE );
+        }
+    }
+    return pool;
+}
+
+int defaultThreads( void )
+{
+    long cores = sysconf( _SC_NPROCESSORS_ONLN );
+    return cores < 1 ? 1 : (int) cores;
+}
+
+int poolThreads( Pool *pool )
+{
+    return pool->threads;
+}
+
+void runPool( Pool *pool, PoolTask task, void *arg, size_t count )
+{
+    if ( count == 0 ) {
+        return;
+    }
+    pthread_mutex_lock( &pool->lock );
+    pool->task = task;
+    pool->arg = arg;
+    pool->next = 0;
+    pool->count = pool->remaining = count;
+    pool->batch++;
+    pthread_cond_broadcast( &pool->ready );
+    while ( pool->remaining > 0 ) {
+        pthread_cond_wait( &pool->finished, &pool->lock );
+    }
+    pthread_mutex_unlock( &pool->lock );
+}
+
+void freePool( Pool *pool )
+{
+    pthread_mutex_lock( &pool->lock );
+    pool->stop = true;
+    pthread_cond_broadcast( &pool->ready );
+    pthread_mutex_unlock( &pool->lock );
+    for ( int i = 0; i < pool->threads; i++ ) {
+        pthread_join( pool->workers[ i ], NULL );
+    }
+    pthread_mutex_destroy( &pool->lock );
+    pthread_cond_destroy( &pool->ready );
+    pthread_cond_destroy( &pool->finished );
+    free( pool->workers );
+    free( pool );
+}
@@ -0,0 +1,71 @@
+/**
+    @file pool.h
+    @author Selena Chen (schen53)
+
+    Header for the pool component, a fixed set of worker threads that can be
+    handed a batch of numbered tasks to run in parallel.
+ */
+
+#ifndef _POOL_H_
+#define _POOL_H_
+
+#include <stddef.h>
+
+/** Short name for the thread pool type. */
+typedef struct PoolStruct Pool;
+
+/**
+    Function run for each task in a batch.
+
+    @param arg argument given to runPool(), shared by all the tasks.
+    @param index number of the task, 0 .. count - 1.
+    @param thread number of the worker thread running the task, 0 .. threads - 1, so each thread
+                  can keep its own buffers.
+ */
+typedef void (*PoolTask)( void *arg, size_t index, int thread );
+
+/**
+    This function makes a pool with the given number of worker threads. If the threads can't be
+    started, it prints an error message and terminates the program.
+
+    @param threads number of worker threads, at least 1.
+    @return dynamically allocated pool.
+ */
+Pool *makePool( int threads );
+
+/**
+    This function returns the number of threads a pool should have by default, one for each
+    processor that's online.
+
+    @return default number of threads, at least 1.
+ */
+int defaultThreads( void );
+
+/**
+    This function returns the number of worker threads in the pool.
+
+    @param pool pool to ask about.
+    @return number of worker threads.
+ */
+int poolThreads( Pool *pool );
+
+/**
+    This function runs task( arg, i, thread ) for every i from 0 to count - 1 on the pool's
+    threads, and returns once all of them have finished. Tasks are handed out in order, one at a
+    time, to whichever thread is free.
+
+    @param pool pool to run the tasks on.
+    @param task function to run for each task.
+    @param arg argument passed to every task.
+    @param count number of tasks.
+ */
+void runPool( Pool *pool, PoolTask task, void *arg, size_t count );
+
+/**
+    This function stops the pool's threads and frees its memory.
+
+    @param pool pool to free.
+ */
+void freePool( Pool *pool );
+
+#endif
@@ -0,0 +1,176 @@
+/**
+    @file scatter.c
+    @author Selena Chen (schen53)
+
+    This component implements keyed scattering of the color bytes that carry a message. The
+    permutation of a scatter block is a few rounds of multiplying by an odd number, adding and
+    xor-shifting, each of which is a bijection on the power-of-two range of indices, with the
+    constants for each round picked by a splitmix64 generator seeded with the key. Since that's
+    the same for every full block, it's worked out once per key into a table, kept for each
+    thread so batch jobs with different keys don't share one, and each block just xors
+    the table entries with its own mask, also computed from the key and the block number with
+    splitmix64. So any block can be shuffled on its own, in any order or on any thread, and the
+    per-block work is a table lookup per color byte, within a block that fits in the L1 cache.
+
+    A block that's smaller than a power of two, which only happens at the end of an image, uses
+    cycle walking instead: an index that lands out of range is mapped again until it's back in
+    range.
+ */
+
+#include <stdbool.h>
+#include <string.h>
+#include "scatter.h"
+
+/** Number of rounds in a block permutation. */
+#define ROUNDS 3
+
+/** Increment of the splitmix64 generator, the golden ratio in 64-bit fixed point. */
+#define GOLDEN 0x9e3779b97f4a7c15ull
+
+/**
+    Returns the next value of a splitmix64 generator.
+
+    @param state pointer to the generator's state, which is advanced.
+    @return next pseudo-random value.
+ */
+static uint64_t splitmix( uint64_t *state )
+{
+    uint64_t z = ( *state += GOLDEN );
+    z = ( z ^ ( z >> 30 ) ) * 0xbf58476d1ce4e5b9ull;
+    z = ( z ^ ( z >> 27 ) ) * 0x94d049bb133111ebull;
+    return z ^ ( z >> 31 );
+}
+
+/**
+    Fills in a table of where a keyed permutation maps each index of a block. Blocks are never
+    bigger than 1 << 16, so 16-bit arithmetic is enough.
+
+    @param table array of count entries to fill in.
+    @param seed seed for the permutation's round constants.
+    @param count number of color bytes in the block, at most SCATTER_SIZE.
+ */
+static void makeTable( uint16_t *table, uint64_t seed, size_t count )
+{
+    int bits = 0;
+    while ( ( (size_t) 1 << bits ) < count ) {
+        bits++;
+    }
+    uint16_t mask = ( 1u << bits ) - 1;
+    int shift = bits / 2 + 1;
+
+    uint16_t mul[ ROUNDS ], add[ ROUNDS ];
+    for ( int r = 0; r < ROUNDS; r++ ) {
+        uint64_t z = splitmix( &seed );
+        mul[ r ] = (uint16_t) z | 1;
+        add[ r ] = (uint16_t) ( z >> 32 );
+    }
+
+    uint16_t walk[ SCATTER_SIZE ];
+    uint16_t *dest = count == (size_t) mask + 1 ? table : walk;
+    for ( uint32_t i = 0; i <= mask; i++ ) {
+        uint16_t x = i;
+        for ( int r = 0; r < ROUNDS; r++ ) {
+            x = (uint16_t) ( x * mul[ r ] + add[ r ] ) & mask;
+            x ^= x >> shift;
+        }
+        dest[ i ] = x;
+    }
+
+    // Walk any index that lands past the end of a partial block along its cycle until it's back
+    // in range.
+    if ( dest == walk ) {
+        for ( uint32_t i = 0; i < count; i++ ) {
+            uint16_t x = walk[ i ];
+            while ( x >= count ) {
+                x = walk[ x ];
+            }
+            table[ i ] = x;
+        }
+    }
+}
+
+/**
+    Returns the table for full scatter blocks with the given key, only working it out again if
+    the key isn't the one this thread last used.
+
+    @param key key from scatterKey().
+    @return this thread's table of SCATTER_SIZE entries.
+ */
+static uint16_t const *fullTable( uint64_t key )
+{
+    static __thread struct {
+        bool ready;
+        uint64_t key;
+        uint16_t table[ SCATTER_SIZE ];
+    } cache;
+    if ( !cache.ready || cache.key != key ) {
+        makeTable( cache.table, key, SCATTER_SIZE );
+        cache.key = key;
+        cache.ready = true;
+    }
+    return cache.table;
+}
+
+uint64_t scatterKey( char const *text )
+{
+    uint64_t state = 0;
+    uint64_t key = splitmix( &state );
+    for ( ; *text; text++ ) {
+        state ^= (unsigned char) *text;
+        key ^= splitmix( &state );
+    }
+    return key;
+}
+
+/**
+    Returns the mask a full scatter block xors its table entries with.
+
+    @param key key from scatterKey().
+    @param block number of the block in the image.
+    @return mask for the block, less than SCATTER_SIZE.
+ */
+static uint16_t blockMask( uint64_t key, size_t block )
+{
+    uint64_t state = key ^ ( block * GOLDEN );
+    return splitmix( &state ) & ( SCATTER_SIZE - 1 );
+}
+
+void gatherScattered( unsigned char *dest, unsigned char const *color, size_t start,
+                      size_t count, uint64_t key )
+{
+    uint16_t table[ SCATTER_SIZE ];
+    size_t full = count / SCATTER_SIZE * SCATTER_SIZE;
+    uint16_t const *perm = full > 0 ? fullTable( key ) : NULL;
+    for ( size_t b = 0; b < full; b += SCATTER_SIZE ) {
+        uint16_t mask = blockMask( key, ( start + b ) / SCATTER_SIZE );
+        for ( int i = 0; i < SCATTER_SIZE; i++ ) {
+            dest[ b + i ] = color[ b + ( perm[ i ] ^ mask ) ];
+        }
+    }
+    if ( full < count ) {
+        makeTable( table, key ^ ( ( start + full ) / SCATTER_SIZE * GOLDEN ), count - full );
+        for ( size_t i = 0; i < count - full; i++ ) {
+            dest[ full + i ] = color[ full + table[ i ] ];
+        }
+    }
+}
+
+void putScattered( unsigned char *color, unsigned char const *src, size_t start,
+                   size_t count, uint64_t key )
+{
+    uint16_t table[ SCATTER_SIZE ];
+    size_t full = count / SCATTER_SIZE * SCATTER_SIZE;
+    uint16_t const *perm = full > 0 ? fullTable( key ) : NULL;
+    for ( size_t b = 0; b < full; b += SCATTER_SIZE ) {
+        uint16_t mask = blockMask( key, ( start + b ) / SCATTER_SIZE );
+        for ( int i = 0; i < SCATTER_SIZE; i++ ) {
+            color[ b + ( perm[ i ] ^ mask ) ] = src[ b + i ];
+        }
+    }
+    if ( full < count ) {
+        makeTable( table, key ^ ( ( start + full ) / SCATTER_SIZE * GOLDEN ), count - full );
+        for ( size_t i = 0; i < count - full; i++ ) {
+            color[ full + table[ i ] ] = src[ full + i ];
+        }
+    }
+}
@@ -0,0 +1,61 @@
+/**
+    @file scatter.h
+    @author Selena Chen (schen53)
+
+    Header for the scatter component, which shuffles the color bytes of an
+    image with a keyed permutation, so the message bits aren't stored in
+    consecutive color bytes.
+*/
+
+#ifndef _SCATTER_H_
+#define _SCATTER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** Number of color bytes in a scatter block.  Color bytes are only
+    moved around within their block, so blocks can be shuffled one at a
+    time as an image is streamed.  This is a multiple of GROUP_SIZE, and
+    BLOCK_SIZE is a multiple of it. */
+#define SCATTER_SIZE 4096
+
+/**
+    Turns a key string into the 64-bit key used to pick permutations.
+
+    @param text key given by the user.
+    @return key for gatherScattered() and putScattered().
+*/
+uint64_t scatterKey( char const *text );
+
+/**
+    Gathers color bytes into the order the message bits are stored in.
+    Within each scatter block, dest[ i ] gets the color byte at the
+    position the key's permutation maps i to.  The color bytes may cover
+    any whole number of scatter blocks, plus the last, partial, block of
+    an image.
+
+    @param dest buffer to store the gathered color bytes in.
+    @param color color bytes, in file order.
+    @param start index in the image of the first color byte, a multiple
+                 of SCATTER_SIZE.
+    @param count number of color bytes.
+    @param key key from scatterKey().
+*/
+void gatherScattered( unsigned char *dest, unsigned char const *color, size_t start,
+                      size_t count, uint64_t key );
+
+/**
+    Puts gathered color bytes back in file order, the reverse of
+    gatherScattered().
+
+    @param color buffer to store the color bytes in, in file order.
+    @param src gathered color bytes.
+    @param start index in the image of the first color byte, a multiple
+                 of SCATTER_SIZE.
+    @param count number of color bytes.
+    @param key key from scatterKey().
+*/
+void putScattered( unsigned char *color, unsigned char const *src, size_t start,
+                   size_t count, uint64_t key );
+
+#endif
@@ -0,0 +1,440 @@
+/**
+    @file stegbatch.c
+    @author Selena Chen (schen53)
+
+    This component implements the stegbatch program, which runs many conceal and extract jobs
+    in one process instead of starting the programs once per image. The jobs are listed in a
+    manifest file, one per line, written just like the command lines they replace:
+
+        conceal [--length] [--check] [--key=K] <input-message> <input-image> <output-image> <bits>
+        extract [--length] [--check] [--key=K] <input-image> <output-message> <bits>
+
+    Blank lines and lines starting with '#' are ignored. The jobs are run on a pool of worker
+    threads, each with its own Image and message buffers that are reused from one image to the
+    next, so a batch of same-size images only allocates for the first one on each thread. A job
+    that fails reports its error and the rest carry on. When everything is done, the number of
+    images, the amount of pixel data and the throughput are printed.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include "bits.h"
+#include "image.h"
+#include "pool.h"
+#include "scatter.h"
+#include "crc.h"
+
+#define CONCEAL_CMD "conceal"
+#define EXTRACT_CMD "extract"
+#define LENGTH_OPT "--length"
+#define CHECK_OPT "--check"
+#define KEY_OPT "--key="
+#define MAX_WORDS 8
+#define BYTES_PER_MB ( 1024.0 * 1024.0 )
+
+/** One conceal or extract job from the manifest. */
+typedef struct {
+    /** True for conceal, false for extract. */
+    bool conceal;
+
+    /** Size of the header before the message, LENGTH_SIZE or CHECK_SIZE, or 0 if the message
+        has a null terminator instead. */
+    size_t header;
+
+    /** True if the message is scattered with key. */
+    bool keyed;
+    uint64_t key;
+
+    /** Message file, for conceal only. */
+    char *message;
+
+    /** Input image. */
+    char *image;
+
+    /** Output image for conceal, or output message for extract. */
+    char *output;
+
+    /** Number of low-order bits used in each color byte. */
+    int userNumBits;
+} Job;
+
+/** Buffers and statistics belonging to one worker thread. */
+typedef struct {
+    /** Current image. Every image the worker reads goes into it, reusing its buffers. */
+    Image image;
+
+    /** Message of the current image, and its capacity. */
+    unsigned char *message;
+    size_t messageCap;
+
+    /** Color bytes gathered into scattered order, for keyed jobs, and their capacity. */
+    unsigned char *gathered;
+    size_t gatheredCap;
+
+    /** Number of images processed, and how many failed. */
+    size_t images, failures;
+
+    /** Number of color bytes processed. */
+    size_t bytes;
+} Worker;
+
+/** Everything the worker threads need to see. */
+typedef struct {
+    Job *jobs;
+    Worker *workers;
+} Batch;
+
+/**
+    Makes sure a buffer can hold at least the given number of bytes, growing it if needed. The old
+    contents aren't kept.
+
+    @param buffer pointer to the buffer.
+    @param cap pointer to the capacity of the buffer.
+    @param size number of bytes needed.
+ */
+static void reserve( unsigned char **buffer, size_t *cap, size_t size )
+{
+    if ( size > *cap ) {
+        free( *buffer );
+        *cap = size > *cap * 2 ? size : *cap * 2;
+        *buffer = (unsigned char *) malloc( *cap );
+        if ( !*buffer ) {
+            fprintf( stderr, "Out of memory\n" );
+            exit( EXIT_FAILURE );
+        }
+    }
+}
+
+/**
+    Reports a failed job and counts it.
+
+    @param w worker that ran the job.
+    @param filename file the error is about.
+    @param message error message to print.
+    @return false, so callers can return the result.
+ */
+static bool report( Worker *w, char const *filename, char const *message )
+{
+    fprintf( stderr, "%s: %s\n", filename, message );
+    w->failures++;
+    return false;
+}
+
+/**
+    Reads an image into the worker's Image, reusing the buffers from its previous image.
+
+    @param w worker to read the image for.
+    @param filename name of the image file.
+    @return true if the image was read successfully.
+ */
+static bool loadImage( Worker *w, char const *filename )
+{
+    FILE *fp = fopen( filename, "rb" );
+    if ( !fp ) {
+        return report( w, filename, "Can't open file" );
+    }
+    if ( !readImageInto( fp, &w->image ) ) {
+        fclose( fp );
+        return report( w, filename, "Invalid image file" );
+    }
+    fclose( fp );
+    w->bytes += imageSize( &w->image );
+    return true;
+}
+
+/**
+    Runs a conceal job.
+
+    @param w worker running the job.
+    @param job job to run.
+    @param image the job's input image.
+    @return true if the job succeeded.
+ */
+static bool runConceal( Worker *w, Job *job, Image *image )
+{
+    size_t size = imageSize( image );
+    size_t len = size * job->userNumBits / BITS_PER_BYTE;
+    size_t header = job->header;
+    if ( len == 0 || header > len ) {
+        return report( w, job->message, "Invalid number of bits" );
+    }
+
+    // Read the whole message, leaving room for the header and zero-filling the rest of the
+    // buffer, so a message shorter than the image gets its null terminator.
+    size_t mCap = ( size * job->userNumBits + BITS_PER_BYTE - 1 ) / BITS_PER_BYTE;
+    reserve( &w->message, &w->messageCap, mCap + 1 );
+    FILE *src = fopen( job->message, "rb" );
+    if ( !src ) {
+        return report( w, job->message, "Can't open file" );
+    }
+    size_t total = fread( w->message + header, sizeof( unsigned char ), mCap + 1 - header, src );
+    fclose( src );
+    if ( total + header > len ) {
+        return report( w, job->message, "Invalid number of bits" );
+    }
+    if ( !header && memchr( w->message, '\0', total ) ) {
+        return report( w, job->message, "Message contains a null character; use --length" );
+    }
+    memset( w->message + header + total, 0, mCap + 1 - header - total );
+    if ( header == CHECK_SIZE ) {
+        putCheck( w->message, total, crc32c( 0, w->message + header, total ) );
+    } else if ( header ) {
+        putLength( w->message, total );
+    }
+    if ( job->keyed ) {
+        reserve( &w->gathered, &w->gatheredCap, size );
+        gatherScattered( w->gathered, image->color, 0, size, job->key );
+        concealBits( w->gathered, size, w->message, job->userNumBits );
+        putScattered( image->color, w->gathered, 0, size, job->key );
+    } else {
+        concealBits( image->color, size, w->message, job->userNumBits );
+    }
+
+    FILE *out = fopen( job->output, "wb" );
+    if ( !out ) {
+        return report( w, job->output, "Can't open file" );
+    }
+    writeHeader( out, image );
+    if ( !writeColor( out, image, image->color, size ) || fclose( out ) != 0 ) {
+        remove( job->output );
+        return report( w, job->output, "Can't write file" );
+    }
+    return true;
+}
+
+/**
+    Runs an extract job.
+
+    @param w worker running the job.
+    @param job job to run.
+    @param image the job's input image.
+    @return true if the job succeeded.
+ */
+static bool runExtract( Worker *w, Job *job, Image *image )
+{
+    size_t size = imageSize( image );
+    size_t limit = size * job->userNumBits / BITS_PER_BYTE;
+    reserve( &w->message, &w->messageCap, limit + 1 );
+    unsigned char *color = image->color;
+    if ( job->keyed ) {
+        reserve( &w->gathered, &w->gatheredCap, size );
+        gatherScattered( w->gathered, color, 0, size, job->key );
+        color = w->gathered;
+    }
+    extractBits( color, size, w->message, job->userNumBits );
+
+    unsigned char *text = w->message;
+    size_t mCount;
+    size_t header = job->header;
+    if ( header ) {
+        uint32_t crc;
+        if ( limit >= header && header == CHECK_SIZE && !getCheck( text, &crc ) ) {
+            return report( w, job->image, "No checked message found" );
+        }
+        uint64_t length = limit < header ? 0 : getLength( text );
+        if ( limit < header || length > limit - header ) {
+            return report( w, job->image, "Invalid message length" );
+        }
+        text += header;
+        mCount = length;
+        if ( header == CHECK_SIZE && crc32c( 0, text, mCount ) != crc ) {
+            return report( w, job->image, "Message checksum mismatch" );
+        }
+    } else {
+        unsigned char *end = memchr( text, '\0', limit );
+        mCount = end ? end - text : limit;
+    }
+
+    FILE *dest = fopen( job->output, "wb" );
+    if ( !dest ) {
+        return report( w, job->output, "Can't open file" );
+    }
+    if ( fwrite( text, sizeof( unsigned char ), mCount, dest ) != mCount
+         || fclose( dest ) != 0 ) {
+        remove( job->output );
+        return report( w, job->output, "Can't write file" );
+    }
+    return true;
+}
+
+/**
+    Pool task running one job of the batch.
+
+    @param arg the Batch.
+    @param index index of the job to run.
+    @param thread index of the worker thread running it.
+ */
+static void runJob( void *arg, size_t index, int thread )
+{
+    Batch *batch = (Batch *) arg;
+    Worker *w = &batch->workers[ thread ];
+    Job *job = &batch->jobs[ index ];
+    w->images++;
+    if ( !loadImage( w, job->image ) ) {
+        return;
+    }
+    if ( job->conceal ) {
+        runConceal( w, job, &w->image );
+    } else {
+        runExtract( w, job, &w->image );
+    }
+}
+
+/**
+    Parses one line of the manifest into a job. The words of the line are copied, so the line
+    buffer can be reused.
+
+    @param line line to parse; it's modified by splitting it into words.
+    @param job job to fill in.
+    @return true if the line held a valid job.
+ */
+static bool parseJob( char *line, Job *job )
+{
+    char *words[ MAX_WORDS + 1 ];
+    int count = 0;
+    for ( char *word = strtok( line, " \t\r\n" ); word; word = strtok( NULL, " \t\r\n" ) ) {
+        if ( count > MAX_WORDS ) {
+            return false;
+        }
+        words[ count++ ] = word;
+    }
+    if ( count == 0 ) {
+        return false;
+    }
+
+    job->conceal = strcmp( words[ 0 ], CONCEAL_CMD ) == 0;
+    if ( !job->conceal && strcmp( words[ 0 ], EXTRACT_CMD ) != 0 ) {
+        return false;
+    }
+    int w = 1;
+    job->header = 0;
+    job->keyed = false;
+    for ( ; w < count && strncmp( words[ w ], "--", 2 ) == 0; w++ ) {
+        if ( strcmp( words[ w ], LENGTH_OPT ) == 0 ) {
+            job->header = job->header ? job->header : LENGTH_SIZE;
+        } else if ( strcmp( words[ w ], CHECK_OPT ) == 0 ) {
+            job->header = CHECK_SIZE;
+        } else if ( strncmp( words[ w ], KEY_OPT, strlen( KEY_OPT ) ) == 0 ) {
+            job->keyed = true;
+            job->key = scatterKey( words[ w ] + strlen( KEY_OPT ) );
+        } else {
+            return false;
+        }
+    }
+    if ( count - w != ( job->conceal ? 4 : 3 ) ) {
+        return false;
+    }
+    job->message = job->conceal ? strdup( words[ w++ ] ) : NULL;
+    job->image = strdup( words[ w++ ] );
+    job->output = strdup( words[ w++ ] );
+    job->userNumBits = atoi( words[ w ] );
+    return job->userNumBits >= 1 && job->userNumBits <= BITS_PER_BYTE;
+}
+
+/**
+    Reads the manifest file. If it can't be read or a line isn't a valid job, it prints an error
+    message and terminates the program.
+
+    @param filename name of the manifest file.
+    @param count pointer to where the number of jobs should be stored.
+    @return dynamically allocated array of jobs.
+ */
+static Job *readManifest( char const *filename, size_t *count )
+{
+    FILE *fp = fopen( filename, "r" );
+    if ( !fp ) {
+        perror( filename );
+        exit( EXIT_FAILURE );
+    }
+    size_t cap = 16;
+    Job *jobs = (Job *) malloc( cap * sizeof( Job ) );
+    *count = 0;
+    char *line = NULL;
+    size_t lineCap = 0;
+    int lineNo = 0;
+    while ( getline( &line, &lineCap, fp ) != -1 ) {
+        lineNo++;
+        char *p = line + strspn( line, " \t\r\n" );
+        if ( *p == '\0' || *p == '#' ) {
+            continue;
+        }
+        if ( *count >= cap ) {
+            cap *= 2;
+            jobs = (Job *) realloc( jobs, cap * sizeof( Job ) );
+        }
+        if ( !parseJob( p, &jobs[ *count ] ) ) {
+            fprintf( stderr, "Invalid manifest, line %d\n", lineNo );
+            exit( EXIT_FAILURE );
+        }
+        ( *count )++;
+    }
+    free( line );
+    fclose( fp );
+    return jobs;
+}
+
+/**
+    Program starting point.
+
+    @param argc number of command line arguments.
+    @param argv command line arguments.
+    @return program exit status.
+ */
+int main( int argc, char *argv[] )
+{
+    if ( argc != 2 && argc != 3 ) {
+        fprintf( stderr, "usage: stegbatch <manifest> [threads]\n" );
+        exit( EXIT_FAILURE );
+    }
+    int threads = argc == 3 ? atoi( argv[ 2 ] ) : defaultThreads();
+    if ( threads < 1 ) {
+        fprintf( stderr, "Invalid number of threads\n" );
+        exit( EXIT_FAILURE );
+    }
+
+    size_t count;
+    Batch batch;
+    batch.jobs = readManifest( argv[ 1 ], &count );
+    batch.workers = (Worker *) calloc( threads, sizeof( Worker ) );
+    for ( int i = 0; i < threads; i++ ) {
+        initImage( &batch.workers[ i ].image );
+    }
+
+    // Every worker packs bits, so pick the kernels before any of them start.
+    chooseKernels();
+
+    struct timespec begin, end;
+    clock_gettime( CLOCK_MONOTONIC, &begin );
+    Pool *pool = makePool( threads );
+    runPool( pool, runJob, &batch, count );
+    freePool( pool );
+    clock_gettime( CLOCK_MONOTONIC, &end );
+
+    size_t images = 0, failures = 0, bytes = 0;
+    for ( int i = 0; i < threads; i++ ) {
+        images += batch.workers[ i ].images;
+        failures += batch.workers[ i ].failures;
+        bytes += batch.workers[ i ].bytes;
+        releaseImage( &batch.workers[ i ].image );
+        free( batch.workers[ i ].message );
+        free( batch.workers[ i ].gathered );
+    }
+    for ( size_t i = 0; i < count; i++ ) {
+        free( batch.jobs[ i ].message );
+        free( batch.jobs[ i ].image );
+        free( batch.jobs[ i ].output );
+    }
+    free( batch.jobs );
+    free( batch.workers );
+
+    double seconds = ( end.tv_sec - begin.tv_sec ) + ( end.tv_nsec - begin.tv_nsec ) / 1e9;
+    double mb = bytes / BYTES_PER_MB;
+    printf( "%zu images (%zu failed), %.1f MB in %.3f s, %.1f MB/s\n", images, failures, mb,
+            seconds, seconds > 0 ? mb / seconds : 0.0 );
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,385 @@
+/**
+    @file stegbench.c
+    @author Selena Chen (schen53)
+
+    This component implements the stegbench program, which measures the throughput of the image
+    pipeline on synthetic images. For each size given on the command line, in megapixels, it
+    generates a PPM image full of noise and a message that fills the image, then times each phase
+    of the pipeline:
+
+        read         readImage() on the image
+        read+write   readImage() and writeImage() to a new file
+        conceal      the conceal program, for each number of bits from 1 to 8
+        extract      the extract program, on each image conceal wrote
+
+    Every phase runs in a child process of its own, so its peak resident set size can be
+    collected separately with wait4(), and its I/O system calls counted from the syscr and syscw
+    lines of /proc/<pid>/io, read while the child is still a zombie. Throughput is reported in
+    megabytes of color bytes per second.
+
+    The files are written in the current directory, or in the directory named by the BENCH_DIR
+    environment variable, and removed at the end.
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include "bits.h"
+#include "image.h"
+
+#define BYTES_PER_MB ( 1024.0 * 1024.0 )
+#define KB_PER_MB 1024.0
+#define PIXELS_PER_MP 1000000
+#define MAX_PATH 1024
+
+/** Number of bytes generated and written at a time. */
+#define CHUNK_SIZE ( 1 << 20 )
+
+/** Names of the files the benchmark uses, relative to the benchmark directory. */
+#define IMAGE_FILE "bench-image.ppm"
+#define MESSAGE_FILE "bench-message.txt"
+#define COPY_FILE "bench-copy.ppm"
+#define CONCEAL_FILE "bench-concealed.ppm"
+#define EXTRACT_FILE "bench-extracted.txt"
+
+/** Measurements of one phase. */
+typedef struct {
+    /** Wall-clock time, in seconds. */
+    double seconds;
+
+    /** Peak resident set size, in kilobytes. */
+    long maxRss;
+
+    /** Number of read and write system calls. */
+    unsigned long long syscalls;
+
+    /** True if the phase exited successfully. */
+    bool ok;
+} Phase;
+
+/** State of the generator used for the synthetic data. */
+static uint64_t noise = 0x2545f4914f6cdd1dull;
+
+/**
+    Returns the next value of the xorshift64 generator used for the synthetic data.
+
+    @return pseudo-random value.
+ */
+static uint64_t nextNoise( void )
+{
+    noise ^= noise << 13;
+    noise ^= noise >> 7;
+    noise ^= noise << 17;
+    return noise;
+}
+
+/**
+    Builds the name of a benchmark file in the benchmark directory.
+
+    @param path buffer of MAX_PATH bytes to store the name in.
+    @param dir benchmark directory.
+    @param name name of the file in the directory.
+    @return path.
+ */
+static char *benchPath( char *path, char const *dir, char const *name )
+{
+    snprintf( path, MAX_PATH, "%s/%s", dir, name );
+    return path;
+}
+
+/**
+    Writes count bytes of synthetic data to a file. Image data is uniform noise, and message data
+    is lowercase letters, so it never holds a null character.
+
+    @param fp file to write to.
+    @param count number of bytes to write.
+    @param text true for message data, false for image data.
+ */
+static void writeNoise( FILE *fp, size_t count, bool text )
+{
+    unsigned char *chunk = (unsigned char *) malloc( CHUNK_SIZE );
+    while ( count > 0 ) {
+        size_t n = count < CHUNK_SIZE ? count : CHUNK_SIZE;
+        for ( size_t i = 0; i < n; i += sizeof( uint64_t ) ) {
+            uint64_t x = nextNoise();
+            for ( size_t j = i; j < n && j < i + sizeof( uint64_t ); j++ ) {
+                chunk[ j ] = text ? 'a' + ( x & 0xff ) % 26 : x & 0xff;
+                x >>= BITS_PER_BYTE;
+            }
+        }
+        if ( fwrite( chunk, sizeof( unsigned char ), n, fp ) != n ) {
+            perror( "stegbench" );
+            exit( EXIT_FAILURE );
+        }
+        count -= n;
+    }
+    free( chunk );
+}
+
+/**
+    Generates a square-ish PPM image of the given size.
+
+    @param filename name of the file to write.
+    @param pixels number of pixels the image should have, at least.
+    @return number of color bytes in the image.
+ */
+static size_t makeImage( char const *filename, size_t pixels )
+{
+    size_t cols = 1;
+    while ( cols * cols < pixels ) {
+        cols++;
+    }
+    size_t rows = ( pixels + cols - 1 ) / cols;
+    FILE *fp = fopen( filename, "wb" );
+    if ( !fp ) {
+        perror( filename );
+        exit( EXIT_FAILURE );
+    }
+    fprintf( fp, "P6\n%zu %zu\n%d\n", cols, rows, MAX_COLOR );
+    size_t size = rows * cols * PIXEL_WIDTH;
+    writeNoise( fp, size, false );
+    fclose( fp );
+    return size;
+}
+
+/**
+    Returns the number of I/O system calls a process has made, from its /proc/<pid>/io file.
+
+    @param pid process to look at.
+    @return number of read and write system calls, or 0 if they can't be counted.
+ */
+static unsigned long long countSyscalls( pid_t pid )
+{
+    char path[ MAX_PATH ];
+    snprintf( path, sizeof( path ), "/proc/%d/io", (int) pid );
+    FILE *fp = fopen( path, "r" );
+    if ( !fp ) {
+        return 0;
+    }
+    unsigned long long total = 0, value;
+    char name[ 32 ];
+    while ( fscanf( fp, "%31[^:]: %llu\n", name, &value ) == 2 ) {
+        if ( strcmp( name, "syscr" ) == 0 || strcmp( name, "syscw" ) == 0 ) {
+            total += value;
+        }
+    }
+    fclose( fp );
+    return total;
+}
+
+/**
+    Waits for a child running one phase and collects its measurements.
+
+    @param pid child running the phase.
+    @param begin time the phase started.
+    @return measurements of the phase.
+ */
+static Phase finishPhase( pid_t pid, struct timespec *begin )
+{
+    Phase phase;
+    siginfo_t info;
+    waitid( P_PID, pid, &info, WEXITED | WNOWAIT );
+    struct timespec end;
+    clock_gettime( CLOCK_MONOTONIC, &end );
+    phase.seconds = ( end.tv_sec - begin->tv_sec ) + ( end.tv_nsec - begin->tv_nsec ) / 1e9;
+    phase.syscalls = countSyscalls( pid );
+
+    int status;
+    struct rusage usage;
+    wait4( pid, &status, 0, &usage );
+    phase.maxRss = usage.ru_maxrss;
+    phase.ok = WIFEXITED( status ) && WEXITSTATUS( status ) == EXIT_SUCCESS;
+    return phase;
+}
+
+/**
+    Runs readImage(), and writeImage() if an output file is given, in a child process.
+
+    @param input image to read.
+    @param output image to write, or NULL to only read.
+    @return measurements of the phase.
+ */
+static Phase runImagePhase( char const *input, char const *output )
+{
+    struct timespec begin;
+    clock_gettime( CLOCK_MONOTONIC, &begin );
+    pid_t pid = fork();
+    if ( pid == 0 ) {
+        Image *image = readImage( input );
+        if ( output ) {
+            writeImage( image, output );
+        }
+        freeImage( image );
+        _exit( EXIT_SUCCESS );
+    }
+    return finishPhase( pid, &begin );
+}
+
+/**
+    Runs one of the programs in a child process, with its standard output discarded.
+
+    @param argv program name and arguments, ending with NULL.
+    @return measurements of the phase.
+ */
+static Phase runProgram( char *const argv[] )
+{
+    struct timespec begin;
+    clock_gettime( CLOCK_MONOTONIC, &begin );
+    pid_t pid = fork();
+    if ( pid == 0 ) {
+        if ( !freopen( "/dev/null", "w", stdout ) ) {
+            _exit( EXIT_FAILURE );
+        }
+        execv( argv[ 0 ], argv );
+        perror( argv[ 0 ] );
+        _exit( EXIT_FAILURE );
+    }
+    return finishPhase( pid, &begin );
+}
+
+/**
+    Prints one line of the report.
+
+    @param mp size of the image in megapixels.
+    @param name name of the phase.
+    @param bits number of bits used in each color byte, or 0 if that doesn't apply.
+    @param size number of color bytes processed.
+    @param phase measurements of the phase.
+ */
+static void report( long mp, char const *name, int bits, size_t size, Phase *phase )
+{
+    double mb = size / BYTES_PER_MB;
+    printf( "%6ld  %-10s  ", mp, name );
+    if ( bits ) {
+        printf( "%4d", bits );
+    } else {
+        printf( "%4s", "-" );
+    }
+    printf( "  %9.1f  %9.1f  %12llu%s\n", phase->seconds > 0 ? mb / phase->seconds : 0.0,
+            phase->maxRss / KB_PER_MB, phase->syscalls, phase->ok ? "" : "  FAILED" );
+    fflush( stdout );
+}
+
+/**
+    Returns the size of a file.
+
+    @param filename name of the file.
+    @return its size, or -1 if it can't be opened.
+ */
+static long long fileSize( char const *filename )
+{
+    FILE *fp = fopen( filename, "rb" );
+    if ( !fp ) {
+        return -1;
+    }
+    fseek( fp, 0, SEEK_END );
+    long long size = ftell( fp );
+    fclose( fp );
+    return size;
+}
+
+/**
+    Runs all the phases on an image of the given size.
+
+    @param dir benchmark directory.
+    @param mp size of the image in megapixels.
+    @return true if every phase succeeded.
+ */
+static bool benchSize( char const *dir, long mp )
+{
+    char image[ MAX_PATH ], message[ MAX_PATH ], copy[ MAX_PATH ];
+    char concealed[ MAX_PATH ], extracted[ MAX_PATH ];
+    benchPath( image, dir, IMAGE_FILE );
+    benchPath( message, dir, MESSAGE_FILE );
+    benchPath( copy, dir, COPY_FILE );
+    benchPath( concealed, dir, CONCEAL_FILE );
+    benchPath( extracted, dir, EXTRACT_FILE );
+
+    size_t size = makeImage( image, (size_t) mp * PIXELS_PER_MP );
+    bool ok = true;
+    Phase phase = runImagePhase( image, NULL );
+    report( mp, "read", 0, size, &phase );
+    ok = ok && phase.ok;
+    phase = runImagePhase( image, copy );
+    report( mp, "read+write", 0, size, &phase );
+    ok = ok && phase.ok;
+    remove( copy );
+
+    // Each message fills the image, leaving room for its null terminator. Going from 8 bits
+    // down, the message file is generated once and then cut down to size.
+    FILE *fp = fopen( message, "wb" );
+    if ( !fp ) {
+        perror( message );
+        exit( EXIT_FAILURE );
+    }
+    writeNoise( fp, size - 1, true );
+    fclose( fp );
+
+    char bitsArg[ 16 ];
+    for ( int bits = BITS_PER_BYTE; bits >= 1; bits-- ) {
+        size_t length = size * bits / BITS_PER_BYTE - 1;
+        if ( truncate( message, length ) != 0 ) {
+            perror( message );
+            exit( EXIT_FAILURE );
+        }
+        snprintf( bitsArg, sizeof( bitsArg ), "%d", bits );
+        char *concealArgs[] = { "./conceal", message, image, concealed, bitsArg, NULL };
+        phase = runProgram( concealArgs );
+        report( mp, "conceal", bits, size, &phase );
+        ok = ok && phase.ok;
+
+        char *extractArgs[] = { "./extract", concealed, extracted, bitsArg, NULL };
+        phase = runProgram( extractArgs );
+        phase.ok = phase.ok && fileSize( extracted ) == (long long) length;
+        report( mp, "extract", bits, size, &phase );
+        ok = ok && phase.ok;
+    }
+
+    remove( image );
+    remove( message );
+    remove( concealed );
+    remove( extracted );
+    return ok;
+}
+
+/**
+    Program starting point.
+
+    @param argc number of command line arguments.
+    @param argv command line arguments.
+    @return program exit status.
+ */
+int main( int argc, char *argv[] )
+{
+    if ( argc < 2 ) {
+        fprintf( stderr, "usage: stegbench <megapixels> ...\n" );
+        exit( EXIT_FAILURE );
+    }
+    char const *dir = getenv( "BENCH_DIR" );
+    if ( !dir ) {
+        dir = ".";
+    }
+
+    printf( "%6s  %-10s  %4s  %9s  %9s  %12s\n", "MP", "phase", "bits", "MB/s", "peak MB",
+            "I/O calls" );
+    fflush( stdout );
+    bool ok = true;
+    for ( int i = 1; i < argc; i++ ) {
+        long mp = atol( argv[ i ] );
+        if ( mp < 1 ) {
+            fprintf( stderr, "Invalid image size: %s\n", argv[ i ] );
+            exit( EXIT_FAILURE );
+        }
+        ok = benchSize( dir, mp ) && ok;
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,241 @@
+/**
+    @file stegstat.c
+    @author Selena Chen (schen53)
+
+    This component implements the stegstat program, for triaging many images quickly. For each
+    image named on the command line, it reads just the header and reports the dimensions and the
+    longest message conceal could hide in it at each number of bits, from 1 to 8.
+
+    With the --stats option, it also makes one streaming pass over the color bytes and reports
+    statistics that hint at whether the image already carries a payload:
+
+    - For each bit plane, the fraction of color bytes with that bit set, and the entropy of the
+      plane in bits per color byte. A plane filled with message bits looks like noise, with half
+      its bits set and an entropy close to 1.
+
+    - A chi-square test on pairs of values that differ only in the low-order bit. Overwriting
+      low-order bits with message bits tends to even out the counts of each pair, so a high
+      p-value suggests the low-order bits have been replaced.
+
+    All of these come from a histogram of the color bytes, so the pass over the pixel data only
+    has to count values; the set bits in each plane are then summed from the histogram instead of
+    counted byte by byte.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+#include "bits.h"
+#include "image.h"
+
+#define STATS_OPT "--stats"
+
+/** Number of distinct color byte values. */
+#define VALUES 256
+
+/** Number of histograms counted side by side, so consecutive equal bytes don't wait on each
+    other's increments. */
+#define LANES 4
+
+/** Iteration limit and tolerance for the incomplete gamma function. */
+#define GAMMA_ITERATIONS 1000
+#define GAMMA_EPSILON 1e-12
+
+/**
+    Returns the regularized lower incomplete gamma function P(a, x), evaluated with its series
+    expansion below a + 1 and its continued fraction above.
+
+    @param a shape parameter, greater than zero.
+    @param x point to evaluate at, at least zero.
+    @return P(a, x).
+ */
+static double gammaP( double a, double x )
+{
+    if ( x <= 0 ) {
+        return 0;
+    }
+    double logPrefix = a * log( x ) - x - lgamma( a );
+    if ( x < a + 1 ) {
+        double term = 1 / a, sum = term;
+        for ( int n = 1; n < GAMMA_ITERATIONS && fabs( term ) > fabs( sum ) * GAMMA_EPSILON;
+              n++ ) {
+            term *= x / ( a + n );
+            sum += term;
+        }
+        return sum * exp( logPrefix );
+    }
+
+    // Lentz's method for the continued fraction of Q(a, x).
+    double tiny = 1e-300;
+    double b = x + 1 - a, c = 1 / tiny, d = 1 / b, h = d;
+    for ( int n = 1; n < GAMMA_ITERATIONS; n++ ) {
+        double an = -n * ( n - a );
+        b += 2;
+        d = an * d + b;
+        d = fabs( d ) < tiny ? tiny : d;
+        c = b + an / c;
+        c = fabs( c ) < tiny ? tiny : c;
+        d = 1 / d;
+        double delta = d * c;
+        h *= delta;
+        if ( fabs( delta - 1 ) < GAMMA_EPSILON ) {
+            break;
+        }
+    }
+    return 1 - exp( logPrefix ) * h;
+}
+
+/**
+    Counts the color byte values of an image, reading its pixel data a block at a time.
+
+    @param fp file to read from, positioned at the start of the pixel data.
+    @param image Image being read.
+    @param hist array of VALUES counts to fill in.
+    @return true if all the pixel data could be read.
+ */
+static bool countValues( FILE *fp, Image *image, size_t *hist )
+{
+    size_t size = imageSize( image );
+    unsigned char *color = (unsigned char *) malloc( BLOCK_SIZE );
+    size_t lanes[ LANES ][ VALUES ];
+    memset( lanes, 0, sizeof( lanes ) );
+    bool ok = true;
+    for ( size_t start = 0; start < size && ok; start += BLOCK_SIZE ) {
+        size_t count = size - start < BLOCK_SIZE ? size - start : BLOCK_SIZE;
+        ok = readColor( fp, image, color, count );
+        size_t i = 0;
+        for ( ; i + LANES <= count; i += LANES ) {
+            for ( int j = 0; j < LANES; j++ ) {
+                lanes[ j ][ color[ i + j ] ]++;
+            }
+        }
+        for ( ; i < count; i++ ) {
+            lanes[ 0 ][ color[ i ] ]++;
+        }
+    }
+    free( color );
+    for ( int v = 0; v < VALUES; v++ ) {
+        hist[ v ] = 0;
+        for ( int j = 0; j < LANES; j++ ) {
+            hist[ v ] += lanes[ j ][ v ];
+        }
+    }
+    return ok;
+}
+
+/**
+    Prints the bit-plane and chi-square statistics of an image's color bytes.
+
+    @param hist counts of each color byte value.
+    @param size number of color bytes.
+ */
+static void printStats( size_t const *hist, size_t size )
+{
+    printf( "  plane  ones      entropy\n" );
+    for ( int plane = 0; plane < BITS_PER_BYTE; plane++ ) {
+        size_t ones = 0;
+        for ( int v = 0; v < VALUES; v++ ) {
+            if ( getBit( v, plane ) ) {
+                ones += hist[ v ];
+            }
+        }
+        double p = size ? (double) ones / size : 0;
+        double entropy = 0;
+        if ( p > 0 && p < 1 ) {
+            entropy = -p * log2( p ) - ( 1 - p ) * log2( 1 - p );
+        }
+        printf( "  %5d  %.6f  %.6f\n", plane, p, entropy );
+    }
+
+    // Compare each even value's count with the average of it and its odd partner, skipping pairs
+    // that never occur.
+    double chi = 0;
+    int pairs = 0;
+    for ( int v = 0; v < VALUES; v += 2 ) {
+        double expected = ( hist[ v ] + hist[ v + 1 ] ) / 2.0;
+        if ( expected > 0 ) {
+            double diff = hist[ v ] - expected;
+            chi += diff * diff / expected;
+            pairs++;
+        }
+    }
+    if ( pairs > 1 ) {
+        double pValue = 1 - gammaP( ( pairs - 1 ) / 2.0, chi / 2 );
+        printf( "  chi-square %.2f over %d pairs, p = %.6f\n", chi, pairs, pValue );
+    } else {
+        printf( "  chi-square undefined, %d pairs\n", pairs );
+    }
+}
+
+/**
+    Reports on one image.
+
+    @param filename name of the image file.
+    @param stats true if the pixel data should be read for statistics.
+    @return true if the image could be read.
+ */
+static bool probe( char const *filename, bool stats )
+{
+    FILE *fp = fopen( filename, "rb" );
+    if ( !fp ) {
+        perror( filename );
+        return false;
+    }
+    Image image;
+    if ( !scanHeader( fp, &image ) ) {
+        fclose( fp );
+        fprintf( stderr, "%s: Invalid image file\n", filename );
+        return false;
+    }
+
+    size_t size = imageSize( &image );
+    printf( "%s: %zux%zu, %d channel%s, %zu color bytes\n", filename, image.cols, image.rows,
+            image.channels, image.channels == 1 ? "" : "s", size );
+    printf( "  capacity" );
+    for ( int bits = 1; bits <= BITS_PER_BYTE; bits++ ) {
+        printf( " %d:%zu", bits, size * bits / BITS_PER_BYTE );
+    }
+    printf( "\n" );
+
+    bool ok = true;
+    if ( stats ) {
+        size_t hist[ VALUES ];
+        ok = countValues( fp, &image, hist );
+        if ( ok ) {
+            printStats( hist, size );
+        } else {
+            fprintf( stderr, "%s: Invalid image file\n", filename );
+        }
+    }
+    clearImage( &image );
+    fclose( fp );
+    return ok;
+}
+
+/**
+    Program starting point.
+
+    @param argc number of command line arguments.
+    @param argv command line arguments.
+    @return program exit status.
+ */
+int main( int argc, char *argv[] )
+{
+    bool stats = false;
+    if ( argc > 1 && strcmp( argv[ 1 ], STATS_OPT ) == 0 ) {
+        stats = true;
+        argc--;
+        argv++;
+    }
+    if ( argc < 2 ) {
+        fprintf( stderr, "usage: stegstat [--stats] <image> ...\n" );
+        exit( EXIT_FAILURE );
+    }
+    bool ok = true;
+    for ( int i = 1; i < argc; i++ ) {
+        ok = probe( argv[ i ], stats ) && ok;
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
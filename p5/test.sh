@@ -6,19 +6,28 @@ testConceal() {
   TESTNO=$1
   IMGFILE=$2
   BITCOUNT=$3
+  OPTIONS=$4
 
-  rm -f output.ppm stdout.txt stderr.txt
+  # Images in other formats have their own file extensions.
+  EXT=ppm
+  for OTHER in pgm bmp; do
+    if [ -f image-$IMGFILE.$OTHER ]; then
+      EXT=$OTHER
+    fi
+  done
+
+  rm -f output.$EXT stdout.txt stderr.txt
 
   # Hide a message file in an image.
-  echo "Conceal test $TESTNO: ./conceal message-$TESTNO.txt image-$IMGFILE.ppm output.ppm $BITCOUNT"
-  ./conceal message-$TESTNO.txt image-$IMGFILE.ppm output.ppm $BITCOUNT > stdout.txt 2> stderr.txt
+  echo "Conceal test $TESTNO: ./conceal $OPTIONS message-$TESTNO.txt image-$IMGFILE.$EXT output.$EXT $BITCOUNT"
+  ./conceal $OPTIONS message-$TESTNO.txt image-$IMGFILE.$EXT output.$EXT $BITCOUNT > stdout.txt 2> stderr.txt
   STATUS=$?
 
   # Make sure the output file looks right.
-  if [ -f concealed-$TESTNO.ppm ]; then
-      if ! diff -q concealed-$TESTNO.ppm output.ppm >/dev/null 2>&1
+  if [ -f concealed-$TESTNO.$EXT ]; then
+      if ! diff -q concealed-$TESTNO.$EXT output.$EXT >/dev/null 2>&1
       then
-	  echo "**** Conceal test $TESTNO FAILED - output didn't match concealed-$TESTNO.ppm"
+	  echo "**** Conceal test $TESTNO FAILED - output didn't match concealed-$TESTNO.$EXT"
 	  FAIL=1
 	  return 1
       fi
@@ -77,6 +86,7 @@ testConceal() {
 testExtract() {
   TESTNO=$1
   BITCOUNT=$2
+  OPTIONS=$3
 
   rm -f output.txt stdout.txt stderr.txt
 
@@ -87,9 +97,15 @@ testExtract() {
       ./extract concealed-$TESTNO.ppm output.txt $BITCOUNT extra > stdout.txt 2> stderr.txt
       STATUS=$?
   else
-      # Recover a message hidden in an image.
-      echo "Extract test $TESTNO: ./extract concealed-$TESTNO.ppm output.txt $BITCOUNT"
-      ./extract concealed-$TESTNO.ppm output.txt $BITCOUNT > stdout.txt 2> stderr.txt
+      # Recover a message hidden in an image, in whatever format it's in.
+      CONCEALED=concealed-$TESTNO.ppm
+      for OTHER in pgm bmp; do
+        if [ -f concealed-$TESTNO.$OTHER ]; then
+          CONCEALED=concealed-$TESTNO.$OTHER
+        fi
+      done
+      echo "Extract test $TESTNO: ./extract $OPTIONS $CONCEALED output.txt $BITCOUNT"
+      ./extract $OPTIONS $CONCEALED output.txt $BITCOUNT > stdout.txt 2> stderr.txt
       STATUS=$?
   fi
 
@@ -152,6 +168,279 @@ testExtract() {
   return 0
 }
 
+# Make sure the fast packing kernels give the same results as the portable ones.
+testKernels() {
+  KERNEL=$1
+
+  for BITCOUNT in 1 2 3 4 5 6 7 8; do
+    rm -f expected.ppm output.ppm output.txt
+
+    echo "Kernel test $KERNEL $BITCOUNT: BITS_KERNEL=$KERNEL ./conceal message-04.txt image-03.ppm output.ppm $BITCOUNT"
+    BITS_KERNEL=portable ./conceal message-04.txt image-03.ppm expected.ppm $BITCOUNT
+    BITS_KERNEL=$KERNEL ./conceal message-04.txt image-03.ppm output.ppm $BITCOUNT
+    if ! cmp -s expected.ppm output.ppm; then
+      echo "**** Kernel test $KERNEL $BITCOUNT FAILED - conceal output didn't match the portable kernel"
+      FAIL=1
+      return 1
+    fi
+
+    BITS_KERNEL=$KERNEL ./extract output.ppm output.txt $BITCOUNT
+    if ! diff -q message-04.txt output.txt >/dev/null 2>&1; then
+      echo "**** Kernel test $KERNEL $BITCOUNT FAILED - extracted message didn't match"
+      FAIL=1
+      return 1
+    fi
+  done
+
+  echo "Kernel test $KERNEL PASS"
+  return 0
+}
+
+# Hide a message in an image, writing the output over the input image itself, and make sure
+# the result matches concealing into a separate file. Without --in-place, a message that
+# doesn't fit should leave the input image alone; with it, the image should still be there.
+testSame() {
+  for OPTS in "" "--in-place" "--in-place --check --key=swordfish"; do
+    rm -f expected.ppm output.ppm
+    ./conceal $OPTS message-07.txt image-03.ppm expected.ppm 2
+    cp image-03.ppm output.ppm
+
+    echo "Same file test: ./conceal $OPTS message-07.txt output.ppm output.ppm 2"
+    ./conceal $OPTS message-07.txt output.ppm output.ppm 2
+    if ! cmp -s expected.ppm output.ppm; then
+      echo "**** Same file test '$OPTS' FAILED - output didn't match a separate output file"
+      FAIL=1
+      return 1
+    fi
+
+    cp image-03.ppm output.ppm
+    cat message-07.txt message-07.txt | ./conceal $OPTS /dev/stdin output.ppm output.ppm 2 2>/dev/null
+    case "$OPTS" in
+      --in-place*) cmp -s -n 15 image-03.ppm output.ppm ;;
+      *) cmp -s image-03.ppm output.ppm ;;
+    esac
+    if [ $? -ne 0 ] || [ $(wc -c < output.ppm) -ne $(wc -c < image-03.ppm) ]; then
+      echo "**** Same file test '$OPTS' FAILED - a message that didn't fit damaged the image"
+      FAIL=1
+      return 1
+    fi
+  done
+
+  echo "Same file test PASS"
+  return 0
+}
+
+# Run a batch of conceal and extract jobs through stegbatch and compare each output with what
+# the standalone programs are expected to produce.
+testKeyed() {
+  for OPTS in "" "--in-place" "--length" "--in-place --length"; do
+    rm -f expected.ppm output.ppm output.txt
+
+    echo "Keyed test: ./conceal $OPTS --key=swordfish message-04.txt image-03.ppm output.ppm 3"
+    ./conceal $OPTS message-04.txt image-03.ppm expected.ppm 3
+    ./conceal $OPTS --key=swordfish message-04.txt image-03.ppm output.ppm 3
+    if cmp -s expected.ppm output.ppm; then
+      echo "**** Keyed test '$OPTS' FAILED - conceal output didn't depend on the key"
+      FAIL=1
+      return 1
+    fi
+
+    LENGTH=""
+    case "$OPTS" in
+      *--length*) LENGTH="--length" ;;
+    esac
+    ./extract $LENGTH --key=swordfish output.ppm output.txt 3
+    if ! diff -q message-04.txt output.txt >/dev/null 2>&1; then
+      echo "**** Keyed test '$OPTS' FAILED - extracted message didn't match"
+      FAIL=1
+      return 1
+    fi
+  done
+
+  echo "Keyed test PASS"
+  return 0
+}
+
+# Hide a message with a checked header in each mode, make sure it comes back out, and make sure
+# extract --check rejects an image without a checked message and one that's been damaged.
+testChecked() {
+  for OPTS in "" "--in-place" "--key=swordfish" "--in-place --key=swordfish"; do
+    rm -f output.ppm output.txt
+
+    echo "Checked test: ./conceal --check $OPTS message-07.txt image-03.ppm output.ppm 2"
+    ./conceal --check $OPTS message-07.txt image-03.ppm output.ppm 2
+    KEY=""
+    case "$OPTS" in
+      *--key=*) KEY="--key=swordfish" ;;
+    esac
+    if ! ./extract --check $KEY output.ppm output.txt 2 ||
+       ! diff -q message-07.txt output.txt >/dev/null 2>&1; then
+      echo "**** Checked test '$OPTS' FAILED - extracted message didn't match"
+      FAIL=1
+      return 1
+    fi
+  done
+
+  # stegbatch should make the same image as conceal, and get the message back out of it.
+  rm -f manifest.txt expected.ppm output-07.ppm output-07.txt
+  ./conceal --check --key=swordfish message-07.txt image-03.ppm expected.ppm 2
+  echo "conceal --check --key=swordfish message-07.txt image-03.ppm output-07.ppm 2" > manifest.txt
+  echo "Checked test: ./stegbatch manifest.txt 1"
+  ./stegbatch manifest.txt 1 > /dev/null
+  echo "extract --check --key=swordfish output-07.ppm output-07.txt 2" > manifest.txt
+  ./stegbatch manifest.txt 1 > /dev/null
+  if ! cmp -s expected.ppm output-07.ppm || ! cmp -s message-07.txt output-07.txt; then
+    echo "**** Checked test FAILED - stegbatch --check didn't match conceal and extract"
+    FAIL=1
+    return 1
+  fi
+
+  rm -f output.txt
+  echo "Checked test: ./extract --check concealed-07.ppm output.txt 2"
+  if ./extract --check concealed-07.ppm output.txt 2 2>/dev/null || [ -e output.txt ]; then
+    echo "**** Checked test FAILED - extract should reject an image without a checked message"
+    FAIL=1
+    return 1
+  fi
+
+  # Flip every bit of one color byte in the middle of the hidden message.
+  BYTE=$(od -An -tu1 -j50000 -N1 expected.ppm)
+  printf "\\$(printf %o $(( 255 - BYTE )))" |
+    dd of=expected.ppm bs=1 seek=50000 conv=notrunc 2>/dev/null
+  echo "Checked test: ./extract --check on a damaged image"
+  if ./extract --check --key=swordfish expected.ppm output.txt 2 2>/dev/null ||
+     [ -e output.txt ]; then
+    echo "**** Checked test FAILED - extract should reject a damaged message"
+    FAIL=1
+    return 1
+  fi
+
+  # The header can't be stored afterward in a pipe, so conceal should give up before writing.
+  echo "Checked test: ./conceal --check message-07.txt image-03.ppm /dev/stdout 2 | wc -c"
+  BYTES=$(./conceal --check message-07.txt image-03.ppm /dev/stdout 2 2>/dev/null | wc -c)
+  if [ "$BYTES" -ne 0 ]; then
+    echo "**** Checked test FAILED - conceal --check wrote an image it couldn't finish"
+    FAIL=1
+    return 1
+  fi
+
+  echo "Checked test PASS"
+  return 0
+}
+
+testBatch() {
+  rm -f manifest.txt output-*.ppm output-*.txt stdout.txt stderr.txt
+
+  cat > manifest.txt <<EOF
+# Same jobs as some of the conceal and extract tests.
+conceal message-01.txt image-01.ppm output-01.ppm 1
+conceal message-07.txt image-03.ppm output-07.ppm 2
+
+conceal --length message-15.txt image-04.ppm output-15.ppm 4
+extract concealed-04.ppm output-04.txt 8
+extract --length concealed-15.ppm output-15.txt 4
+EOF
+
+  echo "Batch test: ./stegbatch manifest.txt 2"
+  if ! ./stegbatch manifest.txt 2 > stdout.txt 2> stderr.txt || [ -s stderr.txt ]; then
+    echo "**** Batch test FAILED - stegbatch should run every job successfully"
+    FAIL=1
+    return 1
+  fi
+  for TESTNO in 01 07 15; do
+    if ! cmp -s concealed-$TESTNO.ppm output-$TESTNO.ppm; then
+      echo "**** Batch test FAILED - output-$TESTNO.ppm didn't match concealed-$TESTNO.ppm"
+      FAIL=1
+      return 1
+    fi
+  done
+  for TESTNO in 04 15; do
+    if ! cmp -s message-$TESTNO.txt output-$TESTNO.txt; then
+      echo "**** Batch test FAILED - output-$TESTNO.txt didn't match message-$TESTNO.txt"
+      FAIL=1
+      return 1
+    fi
+  done
+
+  echo "Batch test PASS"
+  return 0
+}
+
+testStat() {
+  rm -f expected.txt stdout.txt
+
+  cat > expected.txt <<EOF
+image-01.ppm: 8x8, 3 channels, 192 color bytes
+  capacity 1:24 2:48 3:72 4:96 5:120 6:144 7:168 8:192
+image-05.pgm: 16x8, 1 channel, 128 color bytes
+  capacity 1:16 2:32 3:48 4:64 5:80 6:96 7:112 8:128
+EOF
+
+  echo "Stat test: ./stegstat image-01.ppm image-05.pgm"
+  ./stegstat image-01.ppm image-05.pgm > stdout.txt
+  if ! diff -q expected.txt stdout.txt >/dev/null 2>&1; then
+    echo "**** Stat test FAILED - capacity report didn't match"
+    FAIL=1
+    return 1
+  fi
+
+  echo "Stat test: ./stegstat --stats image-03.ppm"
+  if ! ./stegstat --stats image-03.ppm > stdout.txt || ! grep -q "chi-square" stdout.txt; then
+    echo "**** Stat test FAILED - --stats should report a chi-square test"
+    FAIL=1
+    return 1
+  fi
+
+  echo "Stat test PASS"
+  return 0
+}
+
+testDump() {
+  rm -f expected.txt stdout.txt output-a.txt output-b.txt
+  printf 'Hello' > output-a.txt
+  printf 'Help!!' > output-b.txt
+
+  cat > expected.txt <<EOF
+0001 01100101
+0002 01101100
+EOF
+
+  echo "Dump test: ./dumpbits --offset=1 --length=0x2 output-a.txt"
+  ./dumpbits --offset=1 --length=0x2 output-a.txt > stdout.txt
+  if ! diff -q expected.txt stdout.txt >/dev/null 2>&1; then
+    echo "**** Dump test FAILED - windowed dump didn't match"
+    FAIL=1
+    return 1
+  fi
+
+  # Only the differing bytes are printed, with dashes past the end of the shorter file.
+  cat > expected.txt <<EOF
+0003 01101100 01110000
+0004 01101111 00100001
+0005 -------- 00100001
+EOF
+
+  echo "Dump test: ./dumpbits output-a.txt output-b.txt"
+  ./dumpbits output-a.txt output-b.txt > stdout.txt
+  if ! diff -q expected.txt stdout.txt >/dev/null 2>&1; then
+    echo "**** Dump test FAILED - comparison didn't match"
+    FAIL=1
+    return 1
+  fi
+
+  echo "0004 01101111 00100001" > expected.txt
+  echo "Dump test: ./dumpbits --offset=4 --length=1 output-a.txt output-b.txt"
+  ./dumpbits --offset=4 --length=1 output-a.txt output-b.txt > stdout.txt
+  if ! diff -q expected.txt stdout.txt >/dev/null 2>&1; then
+    echo "**** Dump test FAILED - windowed comparison didn't match"
+    FAIL=1
+    return 1
+  fi
+
+  echo "Dump test PASS"
+  return 0
+}
+
 # make a fresh copy of the target programs
 make clean
 make
@@ -168,6 +457,14 @@ if [ -x conceal ] ; then
     testConceal 08 90 3
     testConceal 09 91 2
     testConceal 10 92 5
+    testConceal 13 04 2
+    testConceal 14 04 3 --in-place
+    testConceal 15 04 4 --length
+    testConceal 16 04 4
+    testConceal 17 05 2
+    testConceal 18 06 3 --length
+    testConceal 19 07 2
+    testConceal 20 07 4 --in-place
 else
     echo "**** Your conceal didn't compile successfully, so we couldn't test it."
     FAIL=1
@@ -181,6 +478,13 @@ if [ -x extract ] ; then
     testExtract 05 4
     testExtract 06 3
     testExtract 07 2
+    testExtract 13 2
+    testExtract 14 3
+    testExtract 15 4 --length
+    testExtract 17 2
+    testExtract 18 3 --length
+    testExtract 19 2
+    testExtract 20 4
 
     testExtract 11 9
     testExtract 12 2
@@ -189,6 +493,39 @@ else
     FAIL=1
 fi
 
+if [ -x conceal ] && [ -x extract ] ; then
+    testKernels bmi2
+    testKernels sse2
+    testKernels avx2
+    testKeyed
+    testSame
+fi
+
+if [ -x conceal ] && [ -x extract ] && [ -x stegbatch ] ; then
+    testChecked
+fi
+
+if [ -x stegbatch ] ; then
+    testBatch
+else
+    echo "**** Your stegbatch didn't compile successfully, so we couldn't test it."
+    FAIL=1
+fi
+
+if [ -x stegstat ] ; then
+    testStat
+else
+    echo "**** Your stegstat didn't compile successfully, so we couldn't test it."
+    FAIL=1
+fi
+
+if [ -x dumpbits ] ; then
+    testDump
+else
+    echo "**** Your dumpbits didn't compile successfully, so we couldn't test it."
+    FAIL=1
+fi
+
 if [ $FAIL -ne 0 ]; then
   echo "FAILING TESTS!"
   exit 13
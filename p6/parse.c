@@ -2,8 +2,10 @@
     @file parse.c
     @author Selena Chen (schen53)
 
-    The parse component parses the text of a regular expression and turns it into a collection
-    of Pattern objects that represent it.
+    The parse component parses the text of a regular expression and turns it into a flat
+    array of pattern nodes in postfix order.  Parsing uses an explicit stack of open
+    parenthesized groups rather than recursion, so deeply nested or very long patterns
+    can't overflow the call stack.
   */
 
 #include "parse.h"
@@ -37,165 +39,212 @@ static void invalidPattern()
   exit( EXIT_FAILURE );
 }
 
-// Forward declaration for a parser function defined below.
-static Pattern *parseAlternation( char const *str, int *pos );
+/**
+    Nodes of a pattern being built, along with the depth of the evaluation
+    stack needed to match them.
+  */
+typedef struct {
+  /** Nodes added so far, in postfix order. */
+  PatternNode *nodes;
+
+  /** Number of nodes added so far. */
+  int count;
+
+  /** Number of node results on the evaluation stack after the last node. */
+  int depth;
+
+  /** Largest the evaluation stack gets. */
+  int maxDepth;
+} Builder;
+
+/**
+    Parser state for one level of parentheses.  Concatenation and
+    alternation are both left-associative, so each level just needs the
+    pattern built so far for each of them.
+  */
+typedef struct {
+  /** Index of the concatenation parsed so far, or -1 if there isn't one yet. */
+  int concat;
+
+  /** Index of the alternation parsed so far, or -1 if there isn't one yet. */
+  int alt;
+} Group;
+
+/**
+    Add a node to the end of the pattern being built.  Its sub-patterns
+    must be the results on top of the evaluation stack, so the node's
+    result replaces them there.
+
+    @param b pattern being built.
+    @param kind kind of node to add.
+    @param p1 index of the first sub-pattern, or -1 if there isn't one.
+    @param p2 index of the second sub-pattern, or -1 if there isn't one.
+    @return index of the new node.
+  */
+static int addNode( Builder *b, NodeKind kind, int p1, int p2 )
+{
+  PatternNode *node = b->nodes + b->count;
+  node->kind = kind;
+  node->sym = '\0';
+  node->start = node->len = 0;
+  node->p1 = p1;
+  node->p2 = p2;
+
+  // Pop the sub-patterns and push the result.
+  b->depth -= ( p1 >= 0 ) + ( p2 >= 0 );
+  node->slot = b->depth++;
+  if ( b->depth > b->maxDepth )
+    b->maxDepth = b->depth;
+
+  return b->count++;
+}
 
 /**
     Parse regular expression syntax with the highest precedence,
-    individual, ordinary symbols, start and end anchors, character
-    classes and patterns surrounded by parentheses.
+    individual, ordinary symbols, start and end anchors and character
+    classes.  Patterns surrounded by parentheses are handled by the
+    loop in parsePattern().
 
     @param str string being parsed.
     @param pos pass-by-reference value for the location in str being parsed,
                 increased as characters from str are parsed.
-    @return dynamically allocated representation of the pattern for the next
-            portion of str.
+    @param b pattern being built.
+    @return index of the node for the next portion of str.
   */
-static Pattern *parseAtomicPattern( char const *str, int *pos )
+static int parseAtomicPattern( char const *str, int *pos, Builder *b )
 {
   if ( ordinary( str[ *pos ] ) ) {
-    return makeLiteralPattern( str[ (*pos)++ ] );
+    int node = addNode( b, LITERAL_NODE, -1, -1 );
+    b->nodes[ node ].sym = str[ (*pos)++ ];
+    return node;
   } else if ( str[ *pos ] == '.' ) {
     (*pos)++;
-    return makeAnyCharacterPattern();
+    return addNode( b, ANY_CHARACTER_NODE, -1, -1 );
   } else if ( str[ *pos ] == '^' ) {
     (*pos)++;
-    return makeStartingPattern();
+    return addNode( b, STARTING_NODE, -1, -1 );
   } else if ( str[ *pos ] == '$' ) {
     (*pos)++;
-    return makeEndingPattern();
+    return addNode( b, ENDING_NODE, -1, -1 );
   } else if ( str[ *pos ] == '[' ) {
     int start = *pos + 1;
     (*pos)++;
 
-    int len = 0;
     while ( str[ *pos ] && str[ *pos ] != ']' ) {
       (*pos)++;
-      len++;
     }
 
     if ( !str[ *pos ] ) {
       invalidPattern();
     }
 
-    char *characters = ( char * ) malloc( sizeof( char ) * ( len + 1 ) );
-    for ( int i = start; i < *pos; i++ ) {
-      characters[ i - start ] = str[ i ];
-    }
-    characters[ len ] = '\0';
-
-    (*pos)++;
+    int node = addNode( b, CHARACTER_CLASS_NODE, -1, -1 );
+    b->nodes[ node ].start = start;
+    b->nodes[ node ].len = *pos - start;
 
-    return makeCharacterClassPattern( characters );
-  } else if ( str[ *pos ] == '(' ) {
     (*pos)++;
 
-    Pattern *p = parseAlternation( str, pos );
-
-    if ( str[ *pos ] != ')' ) {
-        invalidPattern();
-    }
-
-    (*pos)++;
-
-    return p;
+    return node;
   }
 
   invalidPattern();
-  return NULL; // Just to make the compiler happy.
+  return -1; // Just to make the compiler happy.
 }
 
 /**
-    Parse regular expression syntax with the second-highest precedence,
-    a pattern, p, optionally followed by one or more repetition syntax like '*' or '+'.
-    If there's no repetition syntax, it just returns the pattern object for p.
+    Parse the optional repetition syntax like '*' or '+' that can follow
+    a pattern, p.  If there's no repetition syntax, it just returns p.
 
     @param str string being parsed.
     @param pos pass-by-reference value for the location in str being parsed,
                 increased as characters from str are parsed.
-    @return dynamically allocated representation of the pattern for the next
-            portion of str.
+    @param b pattern being built.
+    @param p index of the pattern that may be repeated.
+    @return index of the node for the pattern, with any repetition.
   */
-static Pattern *parseRepetition( char const *str, int *pos )
+static int parseRepetition( char const *str, int *pos, Builder *b, int p )
 {
-  Pattern *p = parseAtomicPattern( str, pos );
-
   if ( str[ *pos ] == '*' ) {
     (*pos)++;
-    return makeNoneOrMoreCharacterPattern( p );
+    return addNode( b, NONE_OR_MORE_NODE, p, -1 );
   } else if ( str[ *pos ] == '+' ) {
     (*pos)++;
-    return makeOneOrMoreCharacterPattern( p );
+    return addNode( b, ONE_OR_MORE_NODE, p, -1 );
   } else if ( str[ *pos ] == '?' ) {
     (*pos)++;
-    return makeNoneOrOneCharacterPattern( p );
+    return addNode( b, NONE_OR_ONE_NODE, p, -1 );
   }
 
   return p;
 }
 
-/**
-    Parse regular expression syntax with the third-highest precedence,
-    one pattern, p, (optionally) followed by additional patterns
-    (concatenation).  If there are no additional patterns, it just
-    returns the pattern object for p.
-
-    @param str string being parsed.
-    @param pos pass-by-reference value for the location in str being parsed,
-                increased as characters from str are parsed.
-    @return dynamically allocated representation of the pattern for the next
-            portion of str.
-  */
-static Pattern *parseConcatenation( char const *str, int *pos )
+// Documented in the header.
+Pattern *parsePattern( char const *str )
 {
-  // Parse the first pattern.
-  Pattern *p1 = parseRepetition( str, pos );
-  // While there are additional patterns, parse them.
-  while ( str[ *pos ] && str[ *pos ] != '|' && str[ *pos ] != ')' ) {
-    Pattern *p2 = parseRepetition( str, pos );
+  int n = strlen( str );
 
-    // And build a concatenation pattern to match the sequence.
-    p1 = makeConcatenationPattern( p1, p2 );
-  }
+  // Every character adds at most one atom or repetition, and every
+  // concatenation or alternation joins two of those.
+  Builder b = { malloc( ( 2 * n + 1 ) * sizeof( PatternNode ) ), 0, 0, 0 };
 
-  return p1;
-}
+  // Stack of open groups, with the whole pattern at the bottom.
+  Group *groups = malloc( ( n + 1 ) * sizeof( Group ) );
+  int top = 0;
+  groups[ top ] = ( Group ) { -1, -1 };
 
-/**
-    Parse regular expression syntax with the lowest precedence, one
-    pattern, p, (optionally) followed by additional patterns separated
-    by | (alternation).  If there are no additional patterns, it just
-    returns the pattern object for p.
+  int pos = 0;
+  while ( true ) {
+    char c = str[ pos ];
+    int p;
+
+    if ( c == '(' ) {
+      pos++;
+      groups[ ++top ] = ( Group ) { -1, -1 };
+      continue;
+    } else if ( c == '|' || c == ')' || c == '\0' ) {
+      // Each of these ends a concatenation, which can't be empty, and
+      // adds it to the alternation for this group.
+      Group *g = groups + top;
+      if ( g->concat < 0 )
+        invalidPattern();
+      g->alt = g->alt < 0 ? g->concat : addNode( &b, ALTERNATION_NODE, g->alt, g->concat );
+      g->concat = -1;
+
+      if ( c == '|' ) {
+        pos++;
+        continue;
+      }
+
+      if ( c == '\0' ) {
+        // Complain if there are still open groups.
+        if ( top > 0 )
+          invalidPattern();
+        break;
+      }
+
+      // Complain about a close parenthesis without an open.
+      if ( top == 0 )
+        invalidPattern();
 
-    @param str string being parsed.
-    @param pos pass-by-reference value for the location in str being
-                parsed, increased as characters from str are parsed.
-    @return dynamically allocated representation of the pattern for
-            the next portion of str.
-  */
-static Pattern *parseAlternation( char const *str, int *pos )
-{
-  Pattern *p1 = parseConcatenation( str, pos );
+      // The whole group is an atomic pattern in the enclosing group.
+      p = g->alt;
+      top--;
+      pos++;
+    } else {
+      p = parseAtomicPattern( str, &pos, &b );
+    }
 
-  while ( str[ *pos ] == '|' ) {
-      (*pos)++;
-      Pattern *p2 = parseConcatenation( str, pos );
-      p1 = makeAlternationPattern( p1, p2 );
-  }
+    p = parseRepetition( str, &pos, &b, p );
 
-  return p1;
-}
+    // And build a concatenation pattern to match the sequence.
+    Group *g = groups + top;
+    g->concat = g->concat < 0 ? p : addNode( &b, CONCATENATION_NODE, g->concat, p );
+  }
 
-// Documented in the header.
-Pattern *parsePattern( char const *str )
-{
-  // Parse the argument into a tree of pattern objects.
-  int pos = 0;
-  Pattern *pat = parseAlternation( str, &pos );
+  Pattern *pat = makeFlatPattern( b.nodes, b.count, b.maxDepth, str );
 
-  // Complain if this didn't consume the whole pattern.
-  if ( str[ pos ] )
-    invalidPattern();
+  free( groups );
+  free( b.nodes );
 
   return pat;
 }
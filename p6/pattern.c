@@ -2,13 +2,12 @@
     @file pattern.c
     @author Selena Chen (schen53)
 
-    The pattern component implements the inheritance hierarchy used for regular expressions.
-    It defines the abstract superclass for a Pattern as well as different concrete subclasses
-    for represent various parts of regular expression syntax. The starter includes a partial
-    implementaton for the pattern component. It defines the pattern superclass, along with a
-    few functions that serve as methods for the class. It also includes concrete implementations
-    of pattern for matching ordinary symbols (LiteralPattern) and for matching concatenated
-    patterns (BinaryPattern).
+    The pattern component implements the representation used for regular expressions.
+    A pattern is stored as a flat array of nodes in postfix order, one node for each
+    part of the regular expression syntax (ordinary symbols, anchors, character classes,
+    concatenation, alternation and repetition).  Matching evaluates the nodes in order,
+    keeping the tables for sub-patterns on an explicit stack, so deeply nested patterns
+    don't need a deep call stack to match or to free.
   */
 
 #include "pattern.h"
@@ -17,301 +16,89 @@
 #include <string.h>
 
 /**
-    A simple function that can be used to free the memory for any
-    pattern that doesn't allocate any additional memory other than the
-    struct used to represent it (e.g., if it doesn't contain any
-    sub-patterns).  It's like a default implementation of the destroy
-    method.
-
-    @param pat pattern to free memory for.
-  */
-static void destroySimplePattern( Pattern *pat )
-{
-  // If we don't need fields that are specific to the sub-type, we can just
-  // free the block of memory where the object is stored.
-  free( pat );
-}
-
-/**
-    Type of pattern used to represent a single, ordinary symbol,
-    like 'a' or '5'.
+    Type of pattern used to represent a whole, flattened regular expression.
+    The nodes and the text of the pattern live at the end of the same block of
+    memory as the struct.
   */
 typedef struct {
   // Fields from our superclass.
   void (*match)( Pattern *pat, char const *str, int len, bool (*table)[ len + 1 ] );
   void (*destroy)( Pattern *pat );
 
-  /** Symbol this pattern is supposed to match. */
-  char sym;
-} LiteralPattern;
+  /** Number of nodes in the pattern. */
+  int count;
+
+  /** Number of match tables needed to evaluate the nodes. */
+  int depth;
+
+  /** Text of the pattern, for character classes to refer to. */
+  char *text;
+
+  /** Nodes of the pattern, in postfix order. */
+  PatternNode nodes[];
+} FlatPattern;
 
 /**
-    Overridden match() method for a LiteralPattern.
+    Fill in the table for a single, ordinary symbol, like 'a' or '5'.
 
-    @param pat pointer to the pattern being matched (essentially, a this
-                pointer).
+    @param sym symbol to match.
     @param str input string in which we're finding matches.
     @param len length of str.
-    @param table ( len + 1 ) x ( len + 1 ) array of booleans that
-                  gets filled in with the substrings where this
-                  pattern matches the string.
+    @param table table that gets filled in with the matches.
   */
-static void matchLiteralPattern( Pattern *pat, char const *str, int len,
-                                 bool (*table)[ len + 1 ] )
+static void matchLiteral( char sym, char const *str, int len, bool (*table)[ len + 1 ] )
 {
-  // Cast down to the struct type pat really points to.
-  LiteralPattern *this = (LiteralPattern *) pat;
-
   // Find all occurreces of the symbol we're supposed to match, and
   // mark them in the match table as matching, 1-character substrings.
   for ( int i = 0; i < len; i++ )
-    if ( str[ i ] == this->sym )
+    if ( str[ i ] == sym )
       table[ i ][ i + 1 ] = true;
 }
 
-// Documented in the header.
-Pattern *makeLiteralPattern( char sym )
-{
-  // Make an instance of LiteralPattern, and fill in its state.
-  LiteralPattern *this = (LiteralPattern *) malloc( sizeof( LiteralPattern ) );
-
-  this->match = matchLiteralPattern;
-  this->destroy = destroySimplePattern;
-  this->sym = sym;
-
-  return (Pattern *) this;
-}
-
-/**
-    Type of pattern used to represent a single occurrence of any character.
-  */
-typedef struct {
-  // Fields from our superclass.
-  void (*match)( Pattern *pat, char const *str, int len, bool (*table)[ len + 1 ] );
-  void (*destroy)( Pattern *pat );
-} AnyCharacterPattern;
-
 /**
-    Overridden match() method for a AnyCharacterPattern.
+    Fill in the table for a single occurrence of any character.
 
-    @param pat pointer to the pattern being matched (essentially, a this
-                pointer).
-    @param str input string in which we're finding matches.
-    @param len length of str.
-    @param table ( len + 1 ) x ( len + 1 ) array of booleans that
-                  gets filled in with the substrings where this
-                  pattern matches the string.
+    @param len length of the input string.
+    @param table table that gets filled in with the matches.
   */
-static void matchAnyCharacterPattern( Pattern *pat, char const *str, int len,
-                                      bool (*table)[ len + 1 ] )
+static void matchAnyCharacter( int len, bool (*table)[ len + 1 ] )
 {
   for ( int i = 0; i < len; i++ ) {
     table[ i ][ i + 1 ] = true;
   }
 }
 
-// Documented in the header.
-Pattern *makeAnyCharacterPattern()
-{
-  AnyCharacterPattern *this = (AnyCharacterPattern *) malloc( sizeof( AnyCharacterPattern ) );
-
-  this->match = matchAnyCharacterPattern;
-  this->destroy = destroySimplePattern;
-  
-  return (Pattern *) this;
-}
-
-/**
-    Type of pattern used to represent things at the beginning of the line.
-  */
-typedef struct {
-  // Fields from our superclass.
-  void (*match)( Pattern *pat, char const *str, int len, bool (*table)[ len + 1 ] );
-  void (*destroy)( Pattern *pat );
-} StartingPattern;
-
-/**
-    Overridden match() method for a StartingPattern.
-
-    @param pat pointer to the pattern being matched (essentially, a this
-                pointer).
-    @param str input string in which we're finding matches.
-    @param len length of str.
-    @param table ( len + 1 ) x ( len + 1 ) array of booleans that
-                  gets filled in with the substrings where this
-                  pattern matches the string.
-  */
-static void matchStartingPattern( Pattern *pat, char const *str, int len,
-                                  bool (*table)[ len + 1 ] )
-{
-  table[ 0 ][ 0 ] = true;
-}
-
-// Documented in the header.
-Pattern *makeStartingPattern()
-{
-  StartingPattern *this = (StartingPattern *) malloc( sizeof( StartingPattern ) );
-
-  this->match = matchStartingPattern;
-  this->destroy = destroySimplePattern;
-  
-  return (Pattern *) this;
-}
-
-/**
-    Type of pattern used to represent things at the end of the line.
-  */
-typedef struct {
-  // Fields from our superclass.
-  void (*match)( Pattern *pat, char const *str, int len, bool (*table)[ len + 1 ] );
-  void (*destroy)( Pattern *pat );
-} EndingPattern;
-
-/**
-    Overridden match() method for an EndingPattern.
-
-    @param pat pointer to the pattern being matched (essentially, a this
-                pointer).
-    @param str input string in which we're finding matches.
-    @param len length of str.
-    @param table ( len + 1 ) x ( len + 1 ) array of booleans that
-                  gets filled in with the substrings where this
-                  pattern matches the string.
-  */
-static void matchEndingPattern( Pattern *pat, char const *str, int len,
-                                bool (*table)[ len + 1 ] )
-{
-  table[ len ][ len ] = true;
-}
-
-// Documented in the header.
-Pattern *makeEndingPattern()
-{
-  EndingPattern *this = (EndingPattern *) malloc( sizeof( EndingPattern ) );
-
-  this->match = matchEndingPattern;
-  this->destroy = destroySimplePattern;
-  
-  return (Pattern *) this;
-}
-
-/**
-    Type of pattern used to represent any one character given in the sequence.
-  */
-typedef struct {
-  // Fields from our superclass.
-  void (*match)( Pattern *pat, char const *str, int len, bool (*table)[ len + 1 ] );
-  void (*destroy)( Pattern *pat );
-
-  /** Symbols this pattern is supposed to match. */
-  char *characters;
-} CharacterClassPattern;
-
-/**
-    Free memory for this pattern, including any subpatterns it contains.
-
-    @param pat pattern to free.
-  */
-static void destroyCharacterClassPattern( Pattern *pat )
-{
-  CharacterClassPattern *this = (CharacterClassPattern *) pat;
-  free( this->characters );
-  free( pat );
-}
-
 /**
-    Overridden match() method for a CharacterClassPattern.
+    Fill in the table for any one character given in a sequence.
 
-    @param pat pointer to the pattern being matched (essentially, a this
-                pointer).
+    @param characters symbols to match.
+    @param count number of symbols in characters.
     @param str input string in which we're finding matches.
     @param len length of str.
-    @param table ( len + 1 ) x ( len + 1 ) array of booleans that
-                  gets filled in with the substrings where this
-                  pattern matches the string.
+    @param table table that gets filled in with the matches.
   */
-static void matchCharacterClassPattern( Pattern *pat, char const *str, int len,
-                                        bool (*table)[ len + 1 ] )
+static void matchCharacterClass( char const *characters, int count, char const *str, int len,
+                                 bool (*table)[ len + 1 ] )
 {
-  CharacterClassPattern *this = (CharacterClassPattern *) pat;
-
   for ( int i = 0; i < len; i++ ) {
-    if ( strchr( this->characters, str[ i ] ) ) {
+    if ( memchr( characters, str[ i ], count ) ) {
       table[ i ][ i + 1 ] = true;
     }
   }
 }
 
-// Documented in the header.
-Pattern *makeCharacterClassPattern( char *str )
-{
-  CharacterClassPattern *this = (CharacterClassPattern *) malloc( sizeof( CharacterClassPattern ) );
-
-  this->match = matchCharacterClassPattern;
-  this->destroy = destroyCharacterClassPattern;
-  this->characters = str;
-  
-  return (Pattern *) this;
-}
-
 /**
-    Representation for a type of pattern that contains two sub-patterns
-    (e.g., concatenation).  This representation could be used by more
-    than one type of pattern, as long as it uses a pointer to a
-    different match() function.
-  */
-typedef struct {
-  // Fields from our superclass.
-  void (*match)( Pattern *pat, char const *str, int len, bool (*table)[ len + 1 ] );
-  void (*destroy)( Pattern *pat );
-
-  // Pointers to the two sub-patterns.
-  Pattern *p1, *p2;
-} BinaryPattern;
-
-/**
-    Free memory for this pattern, including any subpatterns it contains.
-
-    @param pat pattern to free.
-  */
-static void destroyBinaryPattern( Pattern *pat )
-{
-  // Cast down to the struct type pat really points to.
-  BinaryPattern *this = (BinaryPattern *) pat;
-
-  // Free our two sub-patterns.
-  this->p1->destroy( this->p1 );
-  this->p2->destroy( this->p2 );
-  // Free the struct representing this object.
-  free( this );
-}
+    Fill in the table for the concatenation of two sub-patterns.
 
-/**
-    Overridden match() method for a BinaryPattern used to handle concatenation.
-
-    @param pat pointer to the pattern being matched (essentially, a this
-                pointer).
-    @param str input string in which we're finding matches.
-    @param len length of str.
-    @param table ( len + 1 ) x ( len + 1 ) array of booleans that
-                  gets filled in with the substrings where this
-                  pattern matches the string.
+    @param len length of the input string.
+    @param tbl1 matches for the first sub-pattern.
+    @param tbl2 matches for the second sub-pattern.
+    @param table table that gets filled in with the matches.
   */
-static void matchConcatenationPattern( Pattern *pat, char const *str, int len,
-                                       bool (*table)[ len + 1 ] )
+static void matchConcatenation( int len, bool (*tbl1)[ len + 1 ], bool (*tbl2)[ len + 1 ],
+                                bool (*table)[ len + 1 ] )
 {
-  // Cast down to the struct type pat really points to.
-  BinaryPattern *this = (BinaryPattern *) pat;
-
-  // Two more tables for matching sub-expressions.
-  bool (*tbl1)[ len + 1 ]  = calloc( ( len + 1 ) * ( len + 1 ), sizeof( bool ) );
-  bool (*tbl2)[ len + 1 ]  = calloc( ( len + 1 ) * ( len + 1 ), sizeof( bool ) );
-
-  //  Let our two sub-patterns figure out everywhere they match.
-  this->p1->match( this->p1, str, len, tbl1 );
-  this->p2->match( this->p2, str, len, tbl2 );
-
-  // Then, based on their matches, look for all places where their
+  // Based on the matches for the sub-patterns, look for all places where their
   // concatenaton matches.  Check all substrings of the input string.
   for ( int begin = 0; begin <= len; begin++ )
     for ( int end = begin; end <= len; end++ ) {
@@ -320,143 +107,41 @@ static void matchConcatenationPattern( Pattern *pat, char const *str, int len,
       // be split into two substrings, the first matching p1 and the second
       // matching p2.
       for ( int k = begin; k <= end; k++ )
-        if ( tbl1[ begin ][ k ] && tbl2[ k ][ end ] )
+        if ( tbl1[ begin ][ k ] && tbl2[ k ][ end ] ) {
           table[ begin ][ end ] = true;
+          break;
+        }
     }
-
-  free( tbl1 );
-  free( tbl2 );
-}
-
-// Documented in the header.
-Pattern *makeConcatenationPattern( Pattern *p1, Pattern *p2 )
-{
-  // Make an instance of Binary pattern and fill in its fields.
-  BinaryPattern *this = (BinaryPattern *) malloc( sizeof( BinaryPattern ) );
-  this->p1 = p1;
-  this->p2 = p2;
-
-  this->match = matchConcatenationPattern;
-  this->destroy = destroyBinaryPattern;
-
-  return (Pattern *) this;
-}
-
-/**
-    Type of pattern used to represent consecutive occurrences of matches.
-  */
-typedef struct {
-  // Fields from our superclass.
-  void (*match)( Pattern *pat, char const *str, int len, bool (*table)[ len + 1 ] );
-  void (*destroy)( Pattern *pat );
-
-  // Pointers to the two sub-patterns.
-  Pattern *p1, *p2;
-} AlternationPattern;
-
-/**
-    Free memory for this pattern, including any subpatterns it contains.
-
-    @param pat pattern to free.
-  */
-static void destroyAlternationPattern( Pattern *pat )
-{
-  AlternationPattern *this = (AlternationPattern *) pat;
-
-  this->p1->destroy( this->p1 );
-  this->p2->destroy( this->p2 );
-  
-  free( this );
 }
 
 /**
-    Overridden match() method for an AlternationPattern.
+    Fill in the table for a match of either of two sub-patterns.
 
-    @param pat pointer to the pattern being matched (essentially, a this
-                pointer).
-    @param str input string in which we're finding matches.
-    @param len length of str.
-    @param table ( len + 1 ) x ( len + 1 ) array of booleans that
-                  gets filled in with the substrings where this
-                  pattern matches the string.
+    @param len length of the input string.
+    @param tbl1 matches for the first sub-pattern.
+    @param tbl2 matches for the second sub-pattern.
+    @param table table that gets filled in with the matches.
   */
-static void matchAlternationPattern( Pattern *pat, char const *str, int len,
-                                     bool (*table)[ len + 1 ] )
+static void matchAlternation( int len, bool (*tbl1)[ len + 1 ], bool (*tbl2)[ len + 1 ],
+                              bool (*table)[ len + 1 ] )
 {
-  AlternationPattern *this = (AlternationPattern *) pat;
-
-  bool (*tbl1)[ len + 1 ]  = calloc( ( len + 1 ) * ( len + 1 ), sizeof( bool ) );
-  bool (*tbl2)[ len + 1 ]  = calloc( ( len + 1 ) * ( len + 1 ), sizeof( bool ) );
-
-  this->p1->match( this->p1, str, len, tbl1 );
-  this->p2->match( this->p2, str, len, tbl2 );
-
   for ( int begin = 0; begin <= len; begin++ ) {
     for ( int end = 0; end <= len; end++ ) {
       table[ begin ][ end ] = tbl1[ begin ][ end ] || tbl2[ begin ][ end ];
     }
   }
-
-  free( tbl1 );
-  free( tbl2 );
-}
-
-// Documented in the header.
-Pattern *makeAlternationPattern( Pattern *p1, Pattern *p2 )
-{
-  AlternationPattern *this = (AlternationPattern *) malloc( sizeof( AlternationPattern ) );
-
-  this->match = matchAlternationPattern;
-  this->destroy = destroyAlternationPattern;
-  this->p1 = p1;
-  this->p2 = p2;
-  
-  return (Pattern *) this;
-}
-
-/**
-    Type of pattern used to represent zero or more consecutive occurrences of matches.
-  */
-typedef struct {
-  // Fields from our superclass.
-  void (*match)( Pattern *pat, char const *str, int len, bool (*table)[ len + 1 ] );
-  void (*destroy)( Pattern *pat );
-
-  // Pattern to be matched.
-  Pattern *pattern;
-} NoneOrMoreCharacterPattern;
-
-/**
-    Free memory for this pattern, including any subpatterns it contains.
-
-    @param pat pattern to free.
-  */
-static void destroyNoneOrMoreCharacterPattern( Pattern *pat )
-{
-  NoneOrMoreCharacterPattern *this = (NoneOrMoreCharacterPattern *) pat;
-  this->pattern->destroy( this->pattern );
-  free( this );
 }
 
 /**
-    Overridden match() method for a NoneOrMoreCharacterPattern.
+    Fill in the table for one or more consecutive occurrences of a sub-pattern.
 
-    @param pat pointer to the pattern being matched (essentially, a this
-                pointer).
-    @param str input string in which we're finding matches.
-    @param len length of str.
-    @param table ( len + 1 ) x ( len + 1 ) array of booleans that
-                  gets filled in with the substrings where this
-                  pattern matches the string.
+    @param len length of the input string.
+    @param tbl matches for the sub-pattern.
+    @param table table that gets filled in with the matches.
   */
-static void matchNoneOrMoreCharacterPattern( Pattern *pat, char const *str, int len,
-                                             bool (*table)[ len + 1 ] )
+static void matchOneOrMore( int len, bool (*tbl)[ len + 1 ], bool (*table)[ len + 1 ] )
 {
-  NoneOrMoreCharacterPattern *this = (NoneOrMoreCharacterPattern *) pat;
-
-  bool (*tbl)[ len + 1 ] = calloc( ( len + 1 ) * ( len + 1 ), sizeof( bool ) );
-  this->pattern->match( this->pattern, str, len, tbl );
-  this->pattern->match( this->pattern, str, len, table );
+  memcpy( table, tbl, ( len + 1 ) * ( len + 1 ) * sizeof( bool ) );
 
   for ( int begin = 0; begin <= len; begin++ ) {
       for ( int end = 0; end <= len; end++ ) {
@@ -475,51 +160,25 @@ static void matchNoneOrMoreCharacterPattern( Pattern *pat, char const *str, int
           }
       }
   }
-
-  for ( int i = 0; i <= len; i++ ) {
-      table[ i ][ i ] = true;
-  }
-
-  free( tbl );
-}
-
-// Documented in the header.
-Pattern *makeNoneOrMoreCharacterPattern( Pattern *pat )
-{
-  NoneOrMoreCharacterPattern *this = (NoneOrMoreCharacterPattern *)
-                                      malloc( sizeof( NoneOrMoreCharacterPattern ) );
-  this->pattern = pat;
-  this->match = matchNoneOrMoreCharacterPattern;
-  this->destroy = destroyNoneOrMoreCharacterPattern;
-  return (Pattern *) this;
 }
 
 /**
-    Type of pattern used to represent one or more consecutive occurrences of matches.
-  */
-typedef struct {
-  // Fields from our superclass.
-  void (*match)( Pattern *pat, char const *str, int len, bool (*table)[ len + 1 ] );
-  void (*destroy)( Pattern *pat );
-
-  // Pattern to be matched.
-  Pattern *pattern;
-} OneOrMoreCharacterPattern;
-
-/**
-    Free memory for this pattern, including any subpatterns it contains.
+    Mark the empty substring at every position in the table as matching.
 
-    @param pat pattern to free.
+    @param len length of the input string.
+    @param table table that gets filled in with the matches.
   */
-static void destroyOneOrMoreCharacterPattern( Pattern *pat )
+static void matchEmpty( int len, bool (*table)[ len + 1 ] )
 {
-    OneOrMoreCharacterPattern *this = (OneOrMoreCharacterPattern *) pat;
-    this->pattern->destroy( this->pattern );
-    free( this );
+  for ( int i = 0; i <= len; i++ ) {
+      table[ i ][ i ] = true;
+  }
 }
 
 /**
-    Overridden match() method for a OneOrMoreCharacterPattern.
+    Overridden match() method for a FlatPattern.  Each node is evaluated
+    in order into a scratch table, which is then swapped into the node's
+    slot, where its parent will find it.
 
     @param pat pointer to the pattern being matched (essentially, a this
                 pointer).
@@ -529,99 +188,104 @@ static void destroyOneOrMoreCharacterPattern( Pattern *pat )
                   gets filled in with the substrings where this
                   pattern matches the string.
   */
-static void matchOneOrMoreCharacterPattern( Pattern *pat, char const *str, int len,
-                                            bool (*table)[ len + 1 ] )
+static void matchFlatPattern( Pattern *pat, char const *str, int len,
+                              bool (*table)[ len + 1 ] )
 {
-  OneOrMoreCharacterPattern *this = (OneOrMoreCharacterPattern *) pat;
-
-  bool (*tbl)[ len + 1 ] = calloc( ( len + 1 ) * ( len + 1 ), sizeof( bool ) );
-  this->pattern->match( this->pattern, str, len, tbl );
-  this->pattern->match( this->pattern, str, len, table );
+  FlatPattern *this = (FlatPattern *) pat;
+  size_t size = ( len + 1 ) * ( len + 1 );
+
+  // One block for all the tables on the stack, plus one for scratch.
+  bool *block = calloc( ( this->depth + 1 ) * size, sizeof( bool ) );
+  bool (**tables)[ len + 1 ] = malloc( ( this->depth + 1 ) * sizeof( *tables ) );
+  for ( int i = 0; i <= this->depth; i++ )
+    tables[ i ] = (bool (*)[ len + 1 ]) ( block + i * size );
+
+  for ( int i = 0; i < this->count; i++ ) {
+    PatternNode *node = this->nodes + i;
+    bool (*result)[ len + 1 ] = tables[ this->depth ];
+    bool (*tbl1)[ len + 1 ] = node->p1 >= 0 ? tables[ this->nodes[ node->p1 ].slot ] : NULL;
+    bool (*tbl2)[ len + 1 ] = node->p2 >= 0 ? tables[ this->nodes[ node->p2 ].slot ] : NULL;
+    memset( result, 0, size * sizeof( bool ) );
+
+    switch ( node->kind ) {
+    case LITERAL_NODE:
+      matchLiteral( node->sym, str, len, result );
+      break;
+    case ANY_CHARACTER_NODE:
+      matchAnyCharacter( len, result );
+      break;
+    case STARTING_NODE:
+      result[ 0 ][ 0 ] = true;
+      break;
+    case ENDING_NODE:
+      result[ len ][ len ] = true;
+      break;
+    case CHARACTER_CLASS_NODE:
+      matchCharacterClass( this->text + node->start, node->len, str, len, result );
+      break;
+    case CONCATENATION_NODE:
+      matchConcatenation( len, tbl1, tbl2, result );
+      break;
+    case ALTERNATION_NODE:
+      matchAlternation( len, tbl1, tbl2, result );
+      break;
+    case NONE_OR_MORE_NODE:
+      matchOneOrMore( len, tbl1, result );
+      matchEmpty( len, result );
+      break;
+    case ONE_OR_MORE_NODE:
+      matchOneOrMore( len, tbl1, result );
+      break;
+    case NONE_OR_ONE_NODE:
+      memcpy( result, tbl1, size * sizeof( bool ) );
+      matchEmpty( len, result );
+      break;
+    }
 
-  for ( int begin = 0; begin <= len; begin++ ) {
-      for ( int end = 0; end <= len; end++ ) {
-          if ( tbl[ begin ][ end ] ) {
-              int length = end - begin;
-              int count = 1;
-              while ( end + length * count <= len &&
-                      tbl[ begin + length * count ][ end + length * count ] ) {
-                  count++;
-              }
-              for ( int i = 0; i < count; i++ ) {
-                  for ( int j = begin; j <= begin + length * i; j += length ) {
-                      table[ j ][ end + length * i ] = true;
-                  }
-              }
-          }
-      }
+    // Move the result into this node's slot, and reuse the old table for scratch.
+    tables[ this->depth ] = tables[ node->slot ];
+    tables[ node->slot ] = result;
   }
 
-  free( tbl );
-}
+  // The root is the last node, and its result is at the bottom of the stack.
+  if ( this->count > 0 ) {
+    bool (*root)[ len + 1 ] = tables[ this->nodes[ this->count - 1 ].slot ];
+    for ( int begin = 0; begin <= len; begin++ )
+      for ( int end = 0; end <= len; end++ )
+        if ( root[ begin ][ end ] )
+          table[ begin ][ end ] = true;
+  }
 
-// Documented in the header.
-Pattern *makeOneOrMoreCharacterPattern( Pattern *pat )
-{
-  OneOrMoreCharacterPattern *this = (OneOrMoreCharacterPattern *)
-                                      malloc( sizeof( OneOrMoreCharacterPattern ) );
-  this->pattern = pat;
-  this->match = matchOneOrMoreCharacterPattern;
-  this->destroy = destroyOneOrMoreCharacterPattern;
-  return (Pattern *) this;
+  free( tables );
+  free( block );
 }
 
 /**
-    Type of pattern used to represent none or one consecutive occurrences of matches.
-  */
-typedef struct {
-  // Fields from our superclass.
-  void (*match)( Pattern *pat, char const *str, int len, bool (*table)[ len + 1 ] );
-  void (*destroy)( Pattern *pat );
-
-  // Pattern to be matched.
-  Pattern *pattern;
-} NoneOrOneCharacterPattern;
-
-/**
-    Free memory for this pattern, including any subpatterns it contains.
+    Free memory for this pattern.  Since the nodes and text are in the
+    same block as the struct, this is just one call to free().
 
     @param pat pattern to free.
   */
-static void destroyNoneOrOneCharacterPattern( Pattern *pat )
+static void destroyFlatPattern( Pattern *pat )
 {
-    NoneOrOneCharacterPattern *this = (NoneOrOneCharacterPattern *) pat;
-    this->pattern->destroy( this->pattern );
-    free( this );
-}
-
-/**
-    Overridden match() method for a NoneOrOneCharacterPattern.
-
-    @param pat pointer to the pattern being matched (essentially, a this
-                pointer).
-    @param str input string in which we're finding matches.
-    @param len length of str.
-    @param table ( len + 1 ) x ( len + 1 ) array of booleans that
-                  gets filled in with the substrings where this
-                  pattern matches the string.
-  */
-static void matchNoneOrOneCharacterPattern( Pattern *pat, char const *str, int len,
-                                            bool (*table)[ len + 1 ] )
-{
-  NoneOrOneCharacterPattern *this = (NoneOrOneCharacterPattern *) pat;
-  this->pattern->match( this->pattern, str, len, table );
-  for ( int i = 0; i <= len; i++ ) {
-      table[ i ][ i ] = true;
-  }
+  free( pat );
 }
 
 // Documented in the header.
-Pattern *makeNoneOrOneCharacterPattern( Pattern *pat )
+Pattern *makeFlatPattern( PatternNode const *nodes, int count, int depth, char const *text )
 {
-  NoneOrOneCharacterPattern *this = (NoneOrOneCharacterPattern *)
-                                      malloc( sizeof( NoneOrOneCharacterPattern ) );
-  this->pattern = pat;
-  this->match = matchNoneOrOneCharacterPattern;
-  this->destroy = destroyNoneOrOneCharacterPattern;
+  size_t textLen = strlen( text );
+  FlatPattern *this = (FlatPattern *) malloc( sizeof( FlatPattern ) +
+                                              count * sizeof( PatternNode ) +
+                                              textLen + 1 );
+
+  this->match = matchFlatPattern;
+  this->destroy = destroyFlatPattern;
+  this->count = count;
+  this->depth = depth;
+  memcpy( this->nodes, nodes, count * sizeof( PatternNode ) );
+  this->text = (char *) ( this->nodes + count );
+  memcpy( this->text, text, textLen + 1 );
+
   return (Pattern *) this;
 }
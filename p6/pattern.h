@@ -47,86 +47,62 @@ struct PatternStruct {
   void (*destroy)( Pattern *pat );
 };
 
-/**
-    Makes a pattern for a single, non-special character, like `a` or `5`.
-
-    @param sym symbol this pattern is supposed to match.
-    @return dynamically allocated representation for this new pattern.
-  */
-Pattern *makeLiteralPattern( char sym );
-
-/**
-    Makes a pattern for a single occurrence of any character.
-
-    @return dynamically allocated representation for this new pattern.
-  */
-Pattern *makeAnyCharacterPattern();
-
-/**
-    Makes a pattern that will only match things at the beginning of the line.
-
-    @return dynamically allocated representation for this new pattern.
-  */
-Pattern *makeStartingPattern();
-
-/**
-    Makes a pattern that only match things at the end of the line, or used along
-    with ^, to make patterns that have to match everything on the line.
-
-    @return dynamically allocated representation for this new pattern.
-  */
-Pattern *makeEndingPattern();
-
-/**
-    Makes a pattern that matches any one character given in the sequence.
-
-    @return dynamically allocated representation for this new pattern.
-  */
-Pattern *makeCharacterClassPattern();
-
-/**
-    Make a pattern for the concatenation of patterns p1 and p2.  It
-    should match anything that can be broken into two substrings, s1 and
-    s2, where the p1 matches the first part (s1) and p2 matches the
-    second part (s2).
-
-    @param p1 subpattern for matching the first part of the string.
-    @param p2 subpattern for matching the second part of the string.
-    @return dynamically allocated representation for this new pattern.
-  */
-Pattern *makeConcatenationPattern( Pattern *p1, Pattern *p2 );
+//////////////////////////////////////////////////////////////////////
+// Flattened pattern representation
+
+/** Kinds of node that can appear in a flattened pattern. */
+typedef enum {
+  LITERAL_NODE,
+  ANY_CHARACTER_NODE,
+  STARTING_NODE,
+  ENDING_NODE,
+  CHARACTER_CLASS_NODE,
+  CONCATENATION_NODE,
+  ALTERNATION_NODE,
+  NONE_OR_MORE_NODE,
+  ONE_OR_MORE_NODE,
+  NONE_OR_ONE_NODE
+} NodeKind;
 
 /**
-    Make a pattern for consecutive occurrences of anything p1 and p2 matches.
-
-    @param p1 subpattern for matching the first part of the string.
-    @param p2 subpattern for matching the second part of the string.
-    @return dynamically allocated representation for this new pattern.
+    One node of a flattened pattern.  Nodes are stored in postfix order
+    in a single array, so the sub-patterns of every node come before it
+    and the last node is the root of the whole pattern.
   */
-Pattern *makeAlternationPattern( Pattern *p1, Pattern *p2 );
+typedef struct {
+  /** What this node matches. */
+  NodeKind kind;
 
-/**
-    Make a pattern for zero or more consecutive occurrences of anything p matches
+  /** Symbol matched by a literal node. */
+  char sym;
 
-    @param p pointer to the pattern being matched.
-    @return dynamically allocated representation for this new pattern.
-  */
-Pattern *makeNoneOrMoreCharacterPattern( Pattern *p );
+  /** Offset and length of a character class's symbols in the pattern text. */
+  int start, len;
 
-/**
-    Make a pattern for one or more consecutive occurrences of anything p matches
+  /** Indices of the sub-patterns, or -1 if this node doesn't have them. */
+  int p1, p2;
 
-    @param p pointer to the pattern being matched.
-    @return dynamically allocated representation for this new pattern.
-  */
-Pattern *makeOneOrMoreCharacterPattern( Pattern *p );
+  /**
+      Which of the match tables this node's result is left in.  These are
+      assigned like positions on an evaluation stack, so matching only
+      needs as many tables as the stack ever gets deep.
+    */
+  int slot;
+} PatternNode;
 
 /**
-    Make a pattern for zero or one consecutive occurrences of anything p matches
-
-    @param p pointer to the pattern being matched.
+    Makes a pattern from an array of nodes in postfix order.  The nodes
+    and a copy of the pattern text are kept together in a single block of
+    memory, so the whole pattern is freed with one call to destroy().
+    Matching walks the array in order, so it never recurses, no matter
+    how deeply the pattern is nested.
+
+    @param nodes nodes of the pattern, in postfix order.
+    @param count number of nodes.
+    @param depth number of match tables needed to evaluate the nodes.
+    @param text text of the pattern that character class nodes refer to.
     @return dynamically allocated representation for this new pattern.
   */
-Pattern *makeNoneOrOneCharacterPattern( Pattern *p );
+Pattern *makeFlatPattern( PatternNode const *nodes, int count, int depth, char const *text );
 
 #endif
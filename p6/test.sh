@@ -115,6 +115,14 @@ checkResults 20 1
 
 runTest 21 'this|that' 1
 
+# Deeply nested groups around a long repetition chain, on a small stack, to make sure
+# pattern depth isn't limited by the call stack.
+PATTERN="$(printf '(%.0s' $(seq 45000))$(printf 'x*%.0s' $(seq 20000))b$(printf ')%.0s' $(seq 45000))"
+echo "Test 22: ./ugrep '(((...x*x*x*...b...)))' input-22.txt > output.txt 2> stderr.txt"
+( ulimit -s 1024; ./ugrep "$PATTERN" input-22.txt > output.txt 2> stderr.txt )
+STATUS=$?
+checkResults 22 0
+
 if [ $FAIL -ne 0 ]; then
   echo "FAILING TESTS!"
   exit 13